@@ -3,66 +3,85 @@
 #include <vector>
 #include <queue>
 #include <climits>
-#include <set>
+#include <algorithm>
+#include <chrono>
 #include "structs.h"
+#include "trace.h"
+#include "perf_counters.h"
 
 
+// Implementation of A*. Besides running a whole search with findPath() or plan(), the search
+// can be run a slice at a time with step() or stepUntil(), which return after a bounded
+// amount of work and pick up where they left off on the next call; a game loop or control
+// tick calls one of them each frame until it stops returning in_progress, and a coroutine
+// can do the same, suspending between slices:
+//   while (a_star.step(1000) == SearchStatus::in_progress) { co_await next_frame; }
+// bestPartialPath() can be called between slices to start moving before the search is done
 class AStar {
 private:
 
-	struct Vertex {
-
-		// Location of the preceding vertex in the path in vertices
-		Coordinate prev_vertex = { -1, -1 };
-
-		// Location of vertex in vertices
-		Coordinate loc;
+	// Entry in open_list; f_score is stored with the entry so the heap never reads a value
+	// that has changed since the entry was pushed
+	struct OpenEntry {
 
 		// Sum of estimated cost to goal and cost from start
-		int f_score = INT_MAX;
-
-		// Cost to get from start to vertex
-		int g_score = INT_MAX;
-
-		// Stores type of vertex 
-		Cell type;
+		int f_score;
 
-		// Set to true when vertex is explored and placed in open_list
-		bool in_open = false;
+		// Index of the vertex in grid
+		uint32_t v;
 
-	}; // Vertex struct
+	}; // OpenEntry struct
 
 
-	// Functor to compare two Vertex pointers; returns true if Vertex a's f is greater
-	// than Vertex b's f
+	// Functor to compare two open list entries; returns true if entry a's f is greater
+	// than entry b's f
 	class FComp {
 	public:
 
-		bool operator()(const Vertex* a, const Vertex* b) {
-			return a->f_score > b->f_score;
+		bool operator()(const OpenEntry& a, const OpenEntry& b) {
+			return a.f_score > b.f_score;
 		}
 	}; // class FComp
 
 
 // ---------- Member variables ----------
 
-	// Stores all the vertices in the map
-	std::vector<std::vector<Vertex>> vertices;
+	// Map shared with the other planners; vertex types are read from here
+	const Grid& grid;
 
-	// Used for printing the path
+	// Parent index, g_score, and in_open/closed flags of every vertex in the map
+	SearchState state;
+
+	// Used for printing the path; filled in by reconstructPath()
 	std::vector<std::vector<Cell>> map;
 
-	// Min f_score priority queue; vertex with lowest f_score has highest priority; 
+	// Min f_score priority queue; vertex with lowest f_score has highest priority;
 	// contains vertices that still need to be explored
-	std::priority_queue<Vertex*, std::vector<Vertex*>, FComp> open_list;
-
-	// Contains vertices that have been explored already
-	std::set<Vertex*> closed_list;
+	std::priority_queue<OpenEntry, std::vector<OpenEntry>, FComp> open_list;
 
-	// Finds the shortest path between these two vertices
+	// Finds the shortest path between start and the nearest of goals
 	Coordinate start;
 
-	Coordinate goal;
+	std::vector<Coordinate> goals;
+
+	// Number of goals to reach before the search stops
+	size_t max_goals;
+
+	// Indices of the goals reached so far, in the order they were reached
+	std::vector<uint32_t> reached;
+
+	// Set by plan(); search() gives up as soon as it is cancelled
+	const CancelToken* cancel = nullptr;
+
+	// State of the search; start is only pushed into open_list by the first slice
+	SearchStatus status = SearchStatus::in_progress;
+
+	bool started = false;
+
+	// Closed vertex with the lowest estimated cost to goal, and that estimate
+	uint32_t best_v = SearchState::no_parent;
+
+	int best_h = INT_MAX;
 
 	// Number of vertices explored
 	int num_v_explored = 0;
@@ -75,60 +94,33 @@ public:
 // ---------- Member functions ----------
 
 	// Constructor
-	AStar(const std::vector<std::vector<Cell>>& map_in, const Coordinate& start_in,
-		const Coordinate& goal_in)
-		: map{ map_in }, start{ start_in }, goal{ goal_in } {
-		// Checks that start and goal are walkable spaces
-		if (map_in[start.row][start.col] != Cell::start || map_in[goal.row][goal.col] != Cell::goal) {
+	AStar(const Grid& grid_in, const Coordinate& start_in, const Coordinate& goal_in)
+		: AStar(grid_in, start_in, std::vector<Coordinate>{ goal_in }, 1) {}
+
+	// Searches from start toward several goals at once and stops after max_goals of them
+	// have been reached; plan() then returns the path to the nearest goal and planGoals() the
+	// paths to every goal reached
+	AStar(const Grid& grid_in, const Coordinate& start_in,
+		const std::vector<Coordinate>& goals_in, size_t max_goals_in = 1)
+		: grid{ grid_in }, state{ grid_in.size(), true },
+		start{ start_in }, goals{ goals_in }, max_goals{ max_goals_in } {
+		// Checks that start and every goal are walkable spaces
+		bool valid = grid.isWalkable(grid.index(start)) && !goals.empty();
+		for (const Coordinate& goal : goals) {
+			valid = valid && grid.isWalkable(grid.index(goal));
+		}
+		if (!valid) {
 			std::cerr << "Invalid start or goal coordinate\n";
 			exit(1);
 		}
-
-		// Initializes vertices to be the same size as map_in
-		size_t rows = map_in.size();
-		size_t cols = map_in[0].size();
-		vertices = std::vector<std::vector<Vertex>>(rows, std::vector<Vertex>(cols));
-
-		// Gives each vertex the correct type and location
-		for (int i = 0; i < rows; ++i) {
-			for (int j = 0; j < cols; ++j) {
-				vertices[i][j].loc = { i, j };
-				vertices[i][j].type = map_in[i][j];
-			}
+		for (const Coordinate& goal : goals) {
+			state.set(grid.index(goal), SearchState::goal);
 		}
 	} // AStar()
 
 	// Uses A* to find the shortest path between start and goal
 	std::vector<std::vector<Cell>> findPath() {
-		// Calculate start's f_score and add it to open_list
-		Vertex* v_start = &(vertices[start.row][start.col]);
-		v_start->g_score = 0;
-		v_start->f_score = calculateH(v_start);
-		open_list.push(v_start);
-		v_start->in_open = true;
-
-		while (!open_list.empty()) {
-			// Get vertex with lowest f_score out of open_list
-			Vertex* v_min = open_list.top();
-			open_list.pop();
-			v_min->in_open = false;
-			// If v_min is already in the closed_list, meaning v_min is a duplicate of 
-			// a vertex that has already been explored, move on to the next v_min
-			if (closed_list.find(v_min) != closed_list.end()) {
-				continue;
-			}
-			// Put v_min in closed list
-			closed_list.insert(v_min);
-
-			// If v_min is the goal, we have found the shortest path between start and goal
-			if (v_min->loc == goal) {
-				break;
-			}
-			// Process min_v's adjacent vertices; calculate their f_scores and add them to 
-			// open_list
-			updateAdj(v_min);
-		}
-
+		search();
 		// Backtrack from goal to start to find the shortest path between start and goal
 		reconstructPath();
 		// Print data describing path
@@ -137,64 +129,212 @@ public:
 		return map;
 	} // findPath()
 
+	// Same as findPath(), but prints nothing and returns the cells of the path instead of
+	// a map; the search gives up early if cancel_in is set
+	PathResult plan(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search()) {
+			return { {}, num_v_explored, true };
+		}
+		PerfScope perf_scope(PerfPhase::reconstruct);
+		return { state.extractPath(grid, grid.index(start), firstGoal()), num_v_explored };
+	} // plan()
+
+	// Same as plan(), but returns the paths to every goal reached, all taken from the same
+	// search tree
+	MultiPathResult planGoals(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search()) {
+			return { {}, num_v_explored, true };
+		}
+		MultiPathResult result{ {}, num_v_explored };
+		for (uint32_t v_goal : reached) {
+			result.paths.push_back(state.extractPath(grid, grid.index(start), v_goal));
+		}
+		return result;
+	} // planGoals()
+
+	// Closes at most max_expansions more vertices, then returns whether the search is still
+	// in progress, found its goal, or failed; later calls continue the same search
+	SearchStatus step(int max_expansions) {
+		return runSlice([&max_expansions]() {
+			return max_expansions-- > 0;
+		});
+	} // step()
+
+	// Same as step(), but keeps closing vertices until deadline has passed; the clock is
+	// checked every 64 vertices, so the slice may run over by that many expansions
+	SearchStatus stepUntil(std::chrono::steady_clock::time_point deadline) {
+		int until_check = 0;
+		return runSlice([&until_check, deadline]() {
+			if (until_check-- > 0) {
+				return true;
+			}
+			until_check = 63;
+			return std::chrono::steady_clock::now() < deadline;
+		});
+	} // stepUntil()
+
+	// Path from start to the goal once the search has found it; until then, the path to the
+	// closed vertex that looks closest to goal, which a caller can start following while the
+	// search continues. Empty before the first slice
+	std::vector<Coordinate> bestPartialPath() const {
+		if (status == SearchStatus::found) {
+			return state.extractPath(grid, grid.index(start), firstGoal());
+		}
+		if (best_v == SearchState::no_parent) {
+			return {};
+		}
+		return state.extractPath(grid, grid.index(start), best_v);
+	} // bestPartialPath()
+
+	// Number of vertices explored so far
+	int numExplored() const {
+		return num_v_explored;
+	} // numExplored()
+
 private:
 
-	// Estimates the cost to get from v to goal
-	int calculateH(Vertex* v) {
-		Vertex* v_goal = &(vertices[goal.row][goal.col]);
-		int x_dist = abs(v_goal->loc.col - v->loc.col);
-		int y_dist = abs(v_goal->loc.row - v->loc.row);
-		return x_dist + y_dist;
+	// Runs A* until max_goals goals are closed or open_list is empty; returns false
+	// if it was cancelled first
+	bool search() {
+		PerfScope perf_scope(PerfPhase::search);
+		return runSlice([]() {
+			return true;
+		}) != SearchStatus::in_progress;
+	} // search()
+
+	// Runs A* while has_budget() returns true before each vertex is closed, until max_goals
+	// goals are closed, open_list is empty, or the search is cancelled; stale entries that close
+	// nothing are not charged to the budget. Returns in_progress if it stopped for lack of
+	// budget or because it was cancelled
+	template <typename Budget>
+	SearchStatus runSlice(Budget has_budget) {
+		if (status != SearchStatus::in_progress) {
+			return status;
+		}
+		if (!started) {
+			// Calculate start's f_score and add it to open_list
+			uint32_t v_start = grid.index(start);
+			state.g_score[v_start] = 0;
+			open_list.push({ calculateH(v_start), v_start });
+			state.set(v_start, SearchState::in_open);
+			TRACE_SEARCH(begin, v_start, 0, calculateH(v_start));
+			started = true;
+		}
+
+		while (!open_list.empty()) {
+			// Stop early if the search has been cancelled
+			if (isCancelled(cancel)) {
+				return SearchStatus::in_progress;
+			}
+			// Get vertex with lowest f_score out of open_list
+			OpenEntry top = open_list.top();
+			uint32_t v_min = top.v;
+			// If v_min is already closed, meaning v_min is a duplicate of a vertex that
+			// has already been explored, drop it and move on to the next v_min; this costs
+			// no budget, since no vertex is closed
+			if (state.test(v_min, SearchState::closed)) {
+				open_list.pop();
+				TRACE_SEARCH(pop, v_min, state.g_score[v_min], top.f_score);
+				continue;
+			}
+			// Stop with v_min still in open_list if the slice is used up
+			if (!has_budget()) {
+				return SearchStatus::in_progress;
+			}
+			open_list.pop();
+			TRACE_SEARCH(pop, v_min, state.g_score[v_min], top.f_score);
+			state.reset(v_min, SearchState::in_open);
+			// Close v_min; the first entry of a vertex to be popped has its lowest g_score, so
+			// its f_score minus that g_score is its h
+			state.set(v_min, SearchState::closed);
+			TRACE_SEARCH(expand, v_min, state.g_score[v_min], top.f_score);
+			if (top.f_score - state.g_score[v_min] < best_h) {
+				best_h = top.f_score - state.g_score[v_min];
+				best_v = v_min;
+			}
+
+			// If v_min is a goal, we have found the shortest path between start and v_min;
+			// stop once enough goals have been reached
+			if (state.test(v_min, SearchState::goal)) {
+				reached.push_back(v_min);
+				if (reached.size() >= max_goals) {
+					status = SearchStatus::found;
+					return status;
+				}
+			}
+			// Process min_v's adjacent vertices; calculate their f_scores and add them to
+			// open_list
+			updateAdj(v_min);
+		}
+		status = reached.empty() ? SearchStatus::failed : SearchStatus::found;
+		return status;
+	} // runSlice()
+
+	// Estimates the cost to get from v to the nearest goal; the minimum over goals of the
+	// Manhattan distance is still consistent, so every goal is closed with its shortest path
+	int calculateH(uint32_t v) {
+		Coordinate loc = grid.coord(v);
+		int h = INT_MAX;
+		for (const Coordinate& goal : goals) {
+			int x_dist = abs(goal.col - loc.col);
+			int y_dist = abs(goal.row - loc.row);
+			h = std::min(h, x_dist + y_dist);
+		}
+		return h;
 	} // calculateH()
 
+	// Index of the first goal reached, or of the first goal if none was reached
+	uint32_t firstGoal() const {
+		return reached.empty() ? grid.index(goals[0]) : reached[0];
+	} // firstGoal()
+
 
-	void updateAdj(Vertex* v) {
+	void updateAdj(uint32_t v) {
 		// New g_score for each adjacent vertex
-		int new_g_score = v->g_score + 1;
+		int new_g_score = state.g_score[v] + 1;
+		Coordinate loc = grid.coord(v);
 
 		// Above vertex
 		// Check for out of bounds indexing
-		if (v->loc.row != 0) {
-			Vertex* v_up = &(vertices[v->loc.row - 1][v->loc.col]);
-			updateV(v, v_up, new_g_score);
+		if (loc.row != 0) {
+			updateV(v, grid.above(v), new_g_score);
 		}
 
 		// Below vertex
-		if (v->loc.row != vertices.size() - 1) {
-			Vertex* v_down = &(vertices[v->loc.row + 1][v->loc.col]);
-			updateV(v, v_down, new_g_score);
+		if (loc.row != grid.numRows() - 1) {
+			updateV(v, grid.below(v), new_g_score);
 		}
 
 		// Left vertex
-		if (v->loc.col != 0) {
-			Vertex* v_left = &(vertices[v->loc.row][v->loc.col - 1]);
-			updateV(v, v_left, new_g_score);
+		if (loc.col != 0) {
+			updateV(v, grid.left(v), new_g_score);
 		}
 
 		// Right vertex
-		if (v->loc.col != vertices[0].size() - 1) {
-			Vertex* v_right = &(vertices[v->loc.row][v->loc.col + 1]);
-			updateV(v, v_right, new_g_score);
+		if (loc.col != grid.numCols() - 1) {
+			updateV(v, grid.right(v), new_g_score);
 		}
 	} // updateAdj()
 
 	// Helper function for updateAdj()
-	void updateV(Vertex* v, Vertex* adj_v, int new_g_score) {
-		auto it = closed_list.find(adj_v);
-		// If v_up is walkable and not in closed_list
-		if (isWalkable(adj_v) && it == closed_list.end()) {
+	void updateV(uint32_t v, uint32_t adj_v, int new_g_score) {
+		// If adj_v is walkable and not closed
+		if (grid.isWalkable(adj_v) && !state.test(adj_v, SearchState::closed)) {
 			++num_v_explored;
-			// If new g_score is shorter than v_up's current g_score or v_up is
+			// If new g_score is shorter than adj_v's current g_score or adj_v is
 			// not in the open_list
-			if (new_g_score < adj_v->g_score || !adj_v->in_open) {
-				// Update v_up's g_score, f_score, and prev_vertex
-				adj_v->g_score = new_g_score;
-				adj_v->f_score = new_g_score + calculateH(adj_v);
-				adj_v->prev_vertex = v->loc;
-				// Add v_up to open_list; even if v_up was already in open_list, we
+			if (new_g_score < state.g_score[adj_v] || !state.test(adj_v, SearchState::in_open)) {
+				// Update adj_v's g_score and parent
+				state.g_score[adj_v] = new_g_score;
+				state.parent[adj_v] = v;
+				// Add adj_v to open_list; even if adj_v was already in open_list, we
 				// need to add it again to take the updated f_score into account
-				open_list.push(adj_v);
-				adj_v->in_open = true;
+				int f_score = new_g_score + calculateH(adj_v);
+				open_list.push({ f_score, adj_v });
+				state.set(adj_v, SearchState::in_open);
+				TRACE_SEARCH(push, adj_v, new_g_score, f_score);
 			}
 		}
 	} // updateV()
@@ -202,18 +342,20 @@ private:
 	// Backtrack from goal to find the shortest path between start and goal; sets the type of
 	// each vertex in the path equal to "path"
 	void reconstructPath() {
-		Vertex* v_goal = &(vertices[goal.row][goal.col]);
-		Coordinate v_path = v_goal->prev_vertex;
+		PerfScope perf_scope(PerfPhase::reconstruct);
+		map = grid.toMap();
+		uint32_t v_start = grid.index(start);
+		uint32_t v_path = state.parent[firstGoal()];
 		++total_path_length;
-		while (!(v_path == start)) {
-			if (v_path == Coordinate{ -1, -1 }) {
+		while (v_path != v_start) {
+			if (v_path == SearchState::no_parent) {
 				std::cout << "No path found\n";
 				total_path_length = 0;
 				break;
 			}
-			map[v_path.row][v_path.col] = Cell::path;
-			Vertex* v = &(vertices[v_path.row][v_path.col]);
-			v_path = v->prev_vertex;
+			Coordinate loc = grid.coord(v_path);
+			map[loc.row][loc.col] = Cell::path;
+			v_path = state.parent[v_path];
 			++total_path_length;
 		}
 	} // reconstructPath()
@@ -225,10 +367,5 @@ private:
 		std::cout << "Path length: " << total_path_length << "\n\n";
 	} // printData()
 
-	// Returns true if a given vertex is either walkable, start, or goal
-	bool isWalkable(Vertex* v) {
-		return v->type == Cell::walkable || v->type == Cell::start || v->type == Cell::goal;
-	}
-
 
-}; // class AStar
\ No newline at end of file
+}; // class AStar
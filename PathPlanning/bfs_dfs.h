@@ -2,28 +2,14 @@
 
 #include <deque>
 #include "structs.h"
+#include "trace.h"
+#include "perf_counters.h"
 
 
 // Implementation of breadth first search and depth first search
 class BreadthDepthSearch {
 private:
 
-	struct Vertex {
-
-		// Location of the preceding vertex in the path
-		Coordinate prev_vertex = { -1, -1 };
-
-		// Location of vertex in vertices
-		Coordinate loc;
-
-		// Stores type of vertex
-		Cell type;
-
-		// Set to true when vertex is pushed into queue/stack
-		bool visited = false;
-
-	}; // Vertex struct	
-
 	enum class SearchType {
 		stack, queue
 	};
@@ -31,19 +17,32 @@ private:
 
 // ---------- Member variables ----------
 
-	// Stores data about each vertex; keeps track of which vertices have been visited
-	std::vector<std::vector<Vertex>> vertices;
+	// Map shared with the other planners; vertex types are read from here
+	const Grid& grid;
+
+	// Parent index and visited flag of every vertex in the map; a vertex is marked in_open
+	// when it is pushed into the queue/stack
+	SearchState state;
 
-	// Used for printing the path
+	// Used for printing the path; filled in by reconstructPath()
 	std::vector<std::vector<Cell>> map;
 
 	// Acts as queue in breadth first search, stack in depth first search
-	std::deque<Vertex*> dq;
+	std::deque<uint32_t> dq;
 
-	// Finds the shortest path between these two vertices
+	// Finds the shortest path between start and the nearest of goals
 	Coordinate start;
 
-	Coordinate goal;
+	std::vector<Coordinate> goals;
+
+	// Number of goals to reach before the search stops
+	size_t max_goals;
+
+	// Indices of the goals reached so far, in the order they were reached
+	std::vector<uint32_t> reached;
+
+	// Set by plan(); search() gives up as soon as it is cancelled
+	const CancelToken* cancel = nullptr;
 
 	// Number of vertices explored
 	int num_v_explored = 0;
@@ -58,26 +57,27 @@ public:
 
 
 	// Constructor
-	BreadthDepthSearch(const std::vector<std::vector<Cell>>& map_in, const Coordinate& start_in,
-		const Coordinate& goal_in)
-		: map{ map_in }, start{ start_in }, goal{ goal_in } {
-		// Checks that start and goal are walkable spaces
-		if (map_in[start.row][start.col] != Cell::start || map_in[goal.row][goal.col] != Cell::goal) {
+	BreadthDepthSearch(const Grid& grid_in, const Coordinate& start_in, const Coordinate& goal_in)
+		: BreadthDepthSearch(grid_in, start_in, std::vector<Coordinate>{ goal_in }, 1) {}
+
+	// Searches from start toward several goals at once and stops after max_goals of them
+	// have been reached; planBFS() then returns the path to the first goal reached and
+	// planBFSGoals() the paths to every goal reached (likewise for DFS)
+	BreadthDepthSearch(const Grid& grid_in, const Coordinate& start_in,
+		const std::vector<Coordinate>& goals_in, size_t max_goals_in = 1)
+		: grid{ grid_in }, state{ grid_in.size(), false },
+		start{ start_in }, goals{ goals_in }, max_goals{ max_goals_in } {
+		// Checks that start and every goal are walkable spaces
+		bool valid = grid.isWalkable(grid.index(start)) && !goals.empty();
+		for (const Coordinate& goal : goals) {
+			valid = valid && grid.isWalkable(grid.index(goal));
+		}
+		if (!valid) {
 			std::cerr << "Invalid start or goal coordinate\n";
 			exit(1);
 		}
-
-		// Initializes vertices to be the same size as map_in
-		size_t rows = map_in.size();
-		size_t cols = map_in[0].size();
-		vertices = std::vector<std::vector<Vertex>>(rows, std::vector<Vertex>(cols));
-
-		// Gives each vertex the correct type and location
-		for (int i = 0; i < rows; ++i) {
-			for (int j = 0; j < cols; ++j) {
-				vertices[i][j].loc = { i, j };
-				vertices[i][j].type = map_in[i][j];
-			}
+		for (const Coordinate& goal : goals) {
+			state.set(grid.index(goal), SearchState::goal);
 		}
 	} // BreadthDepthSearch()
 
@@ -93,17 +93,99 @@ public:
 		return findPath(SearchType::stack);
 	} // findPathDFS()
 
+	// Same as findPathBFS(), but prints nothing and returns the cells of the path instead
+	// of a map; the search gives up early if cancel_in is set
+	PathResult planBFS(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search(SearchType::queue)) {
+			return { {}, num_v_explored, true };
+		}
+		PerfScope perf_scope(PerfPhase::reconstruct);
+		return { state.extractPath(grid, grid.index(start), firstGoal()), num_v_explored };
+	} // planBFS()
+
+	// Same as planBFS(), but returns the paths to every goal reached, all taken from the same
+	// search tree
+	MultiPathResult planBFSGoals(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search(SearchType::queue)) {
+			return { {}, num_v_explored, true };
+		}
+		MultiPathResult result{ {}, num_v_explored };
+		for (uint32_t v_goal : reached) {
+			result.paths.push_back(state.extractPath(grid, grid.index(start), v_goal));
+		}
+		return result;
+	} // planBFSGoals()
+
+	// Same as findPathDFS(), but prints nothing and returns the cells of the path instead
+	// of a map; the search gives up early if cancel_in is set
+	PathResult planDFS(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search(SearchType::stack)) {
+			return { {}, num_v_explored, true };
+		}
+		PerfScope perf_scope(PerfPhase::reconstruct);
+		return { state.extractPath(grid, grid.index(start), firstGoal()), num_v_explored };
+	} // planDFS()
+
+	// Same as planDFS(), but returns the paths to every goal reached, all taken from the same
+	// search tree
+	MultiPathResult planDFSGoals(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search(SearchType::stack)) {
+			return { {}, num_v_explored, true };
+		}
+		MultiPathResult result{ {}, num_v_explored };
+		for (uint32_t v_goal : reached) {
+			result.paths.push_back(state.extractPath(grid, grid.index(start), v_goal));
+		}
+		return result;
+	} // planDFSGoals()
+
 private:
 
 	// Helper function for findPathBFS() and findPathDFS(); 
 	std::vector<std::vector<Cell>> findPath(SearchType type) {
+		search(type);
+		// Backtrack from goal to start to find the shortest path between start and goal
+		reconstructPath();
+		// Print data describing path
+		switch (type) {
+		case SearchType::queue:
+			printBFSData();
+			break;
+		case SearchType::stack:
+			printDFSData();
+			break;
+		}
+
+		return map;
+	} // findPath()
+
+	// Runs BFS or DFS until max_goals goals are found or the deque is empty; returns false
+	// if it was cancelled first
+	bool search(SearchType type) {
+		PerfScope perf_scope(PerfPhase::search);
 		// Mark start vertex as visited and push it into the deque
-		Vertex* start_v = &(vertices[start.row][start.col]);
-		start_v->visited = true;
+		uint32_t start_v = grid.index(start);
+		state.set(start_v, SearchState::in_open);
 		dq.push_back(start_v);
+		TRACE_SEARCH(begin, start_v, -1, -1);
+		// The start never goes through pushV(), so check whether it is a goal here
+		if (state.test(start_v, SearchState::goal)) {
+			reached.push_back(start_v);
+			if (reached.size() >= max_goals) {
+				return true;
+			}
+		}
 
 		while (!dq.empty()) {
-			Vertex* curr_v = nullptr;
+			// Stop early if the search has been cancelled
+			if (isCancelled(cancel)) {
+				return false;
+			}
+			uint32_t curr_v = 0;
 			// If type is queue, meaning BFS, get curr_v from front of the deque; if type is 
 			// stack, meaning DFS, get curr_V from the back or the deque
 			switch (type) {
@@ -116,100 +198,91 @@ private:
 				dq.pop_back();
 				break;
 			}
+			// Every vertex popped is expanded, since it is only pushed once
+			TRACE_SEARCH(expand, curr_v, -1, -1);
 			// If goal is found, break out of while loop
 			if (pushAdj(curr_v)) {
 				break;
 			}
 		} 
-		// Backtrack from goal to start to find the shortest path between start and goal
-		reconstructPath();
-		// Print data describing path
-		switch (type) {
-		case SearchType::queue:
-			printBFSData();
-			break;
-		case SearchType::stack:
-			printDFSData();
-			break;
-		}
-
-		return map;
-	} // findPath()
+		return true;
+	} // search()
 
 
 
-	// Pushes vertices adjacent to v into deque if unvisited; returns true if goal is found, false otherwise
+	// Pushes vertices adjacent to v into deque if unvisited; returns true if the last goal needed
+	// is found, false otherwise
 	// Same for both BFS and DFS
-	bool pushAdj(Vertex* v) {
+	bool pushAdj(uint32_t v) {
+		Coordinate loc = grid.coord(v);
+
 		// Above vertex
-		// Check for out of bounds indexing
-		if (v->loc.row != 0) {
-			Vertex* v_up = &(vertices[v->loc.row - 1][v->loc.col]);
-			pushV(v, v_up);
-			// Return true if v_up is the goal
-			if (v_up->loc == goal) {
-				return true;
-			}
+		// Check for out of bounds indexing; return true if v_up is the last goal needed
+		if (loc.row != 0 && pushV(v, grid.above(v))) {
+			return true;
 		}
 
 		// Below vertex
-		if (v->loc.row != vertices.size() - 1) {
-			Vertex* v_down = &(vertices[v->loc.row + 1][v->loc.col]);
-			pushV(v, v_down);
-			if (v_down->loc == goal) {
-				return true;
-			}
+		if (loc.row != grid.numRows() - 1 && pushV(v, grid.below(v))) {
+			return true;
 		}
 
 		// Left vertex
-		if (v->loc.col != 0) {
-			Vertex* v_left = &(vertices[v->loc.row][v->loc.col - 1]);
-			pushV(v, v_left);
-			if (v_left->loc == goal) {
-				return true;
-			}
+		if (loc.col != 0 && pushV(v, grid.left(v))) {
+			return true;
 		}
 
 		// Right vertex
-		if (v->loc.col != vertices[0].size() - 1) {
-			Vertex* v_right = &(vertices[v->loc.row][v->loc.col + 1]);
-			pushV(v, v_right);
-			if (v_right->loc == goal) {
-				return true;
-			}
+		if (loc.col != grid.numCols() - 1 && pushV(v, grid.right(v))) {
+			return true;
 		}
 		// None of the adjacent vertices are the goal, so return false
 		return false;
 	} // pushAdj()
 
 
-	// Helper function for pushAdj()
-	void pushV(Vertex* v, Vertex* adj_v) {
+	// Helper function for pushAdj(); returns true if adj_v is a goal and enough goals
+	// have now been reached
+	bool pushV(uint32_t v, uint32_t adj_v) {
 		// If adj_v is unvisited and walkable, mark it as visited, push it into deque, 
-		// and set prev_vertex as v
-		if (!adj_v->visited && isWalkable(adj_v)) {
+		// and set its parent as v
+		if (!state.test(adj_v, SearchState::in_open) && grid.isWalkable(adj_v)) {
 			++num_v_explored;
-			adj_v->visited = true;
+			state.set(adj_v, SearchState::in_open);
 			dq.push_back(adj_v);
-			adj_v->prev_vertex = v->loc;
+			TRACE_SEARCH(push, adj_v, -1, -1);
+			state.parent[adj_v] = v;
+			if (state.test(adj_v, SearchState::goal)) {
+				reached.push_back(adj_v);
+				return reached.size() >= max_goals;
+			}
 		}
+		return false;
 	} // pushV()
 
+	// Index of the first goal reached, or of the first goal if none was reached
+	uint32_t firstGoal() const {
+		return reached.empty() ? grid.index(goals[0]) : reached[0];
+	} // firstGoal()
+
+
 	// Backtrack from goal to find the shortest path between start and goal; sets the type of
 	// each vertex in the path equal to "path"
 	void reconstructPath() {
-		Vertex* v_goal = &(vertices[goal.row][goal.col]);
-		Coordinate v_path = v_goal->prev_vertex;
+		PerfScope perf_scope(PerfPhase::reconstruct);
+		map = grid.toMap();
+		uint32_t v_start = grid.index(start);
+		uint32_t v_path = state.parent[firstGoal()];
 		++total_path_length;
-		while (!(v_path == start)) {
-			if (v_path == Coordinate{ -1, -1 }) {
+		while (v_path != v_start) {
+			if (v_path == SearchState::no_parent) {
 				std::cout << "No path found\n";
 				total_path_length = 0;
 				break;
 			}
-			map[v_path.row][v_path.col] = Cell::path;
-			Vertex* v = &(vertices[v_path.row][v_path.col]);
-			v_path = v->prev_vertex;
+			Coordinate loc = grid.coord(v_path);
+			map[loc.row][loc.col] = Cell::path;
+			v_path = state.parent[v_path];
 			++total_path_length;
 		}
 	} // reconstructPath()
@@ -228,9 +301,4 @@ private:
 		std::cout << "Path length: " << total_path_length << "\n\n";
 	} // printDFSData()
 
-	// Returns true if a given vertex is either walkable, start, or goal
-	bool isWalkable(Vertex* v) {
-		return v->type == Cell::walkable || v->type == Cell::start || v->type == Cell::goal;
-	} // isWalkable()
-
 }; // BreadthDepthSearch class
\ No newline at end of file
@@ -0,0 +1,837 @@
+#pragma once
+
+#include <vector>
+#include <set>
+#include <tuple>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include "structs.h"
+
+
+// Conflict-Based Search for many agents on one map. Every agent has a start and a goal; each
+// time step an agent moves to an adjacent cell or waits, and stays at its goal once it is
+// done. No two agents may be in the same cell at the same time or swap cells along an edge.
+// The high level searches a tree of constraint sets: each node holds one path per agent, and
+// a node whose paths conflict is split into two children that each forbid one of the agents
+// from the conflicting cell or move at that time. The low level finds one agent's path
+// under its constraints with a space-time search.
+//
+// With weight 1 this is CBS and the sum of path lengths is minimal. With a weight w > 1 it
+// is ECBS: both levels use focal search, picking among the nodes within w times the best
+// lower bound the one with the fewest conflicts, and the sum of path lengths is at most w
+// times the minimum, usually found with far fewer nodes.
+//
+// Nodes of the constraint tree are independent, so a batch of them is expanded at once on
+// several threads, each with its own low-level search context that is reused for every
+// search it runs. The threads are started for the first batch and then wait for the next
+// one, for as long as the CBS object exists
+class CBS {
+public:
+
+	// Counters describing the last solve()
+	struct Stats {
+
+		// Constraint tree nodes expanded and generated
+		long long high_level_expanded = 0;
+
+		long long high_level_generated = 0;
+
+		// Low-level searches run, and the space-time states they expanded
+		long long low_level_searches = 0;
+
+		long long low_level_expanded = 0;
+
+		// Seconds spent in the low-level searches and in the high level around them (conflict
+		// detection and node bookkeeping), each summed over threads
+		double low_level_seconds = 0;
+
+		double high_level_seconds = 0;
+
+		// Wall time of the whole solve()
+		double total_seconds = 0;
+
+	}; // struct Stats
+
+private:
+
+	// Forbids agent from being at v at time t or, if to is set, from moving from v to to
+	// between time t and t + 1
+	struct Constraint {
+
+		uint32_t agent;
+
+		uint32_t v;
+
+		uint32_t to;
+
+		int t;
+
+	}; // struct Constraint
+
+	// Two agents that are in the same cell at time t (to is no_parent), or that swap cells v
+	// and to between time t and t + 1
+	struct Conflict {
+
+		uint32_t a;
+
+		uint32_t b;
+
+		uint32_t v;
+
+		uint32_t to;
+
+		int t;
+
+	}; // struct Conflict
+
+	using Path = std::vector<uint32_t>;
+
+	// Node of the constraint tree
+	struct HighLevelNode {
+
+		// Parent node, and the constraint this node adds to it
+		uint32_t parent;
+
+		Constraint constraint;
+
+		// Path of every agent; paths that did not change are shared with the parent
+		std::vector<std::shared_ptr<const Path>> paths;
+
+		// Lower bound on each agent's path length under the node's constraints
+		std::vector<int> lower_bounds;
+
+		// Sum of path lengths, and of lower bounds
+		int cost = 0;
+
+		int lower_bound = 0;
+
+		// Number of pairs of conflicting agents, and the earliest conflict
+		int num_conflicts = 0;
+
+		Conflict conflict;
+
+	}; // struct HighLevelNode
+
+	// Paths of the other agents, indexed by cell and time, so the low level can count the
+	// conflicts a move would cause
+	class PathTable {
+	public:
+
+		// Agents at each (cell, time) before they reach their goal
+		std::unordered_map<uint64_t, std::vector<uint32_t>> occupied;
+
+		// Agents parked at each goal cell, with the time they arrived
+		std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, int>>> parked;
+
+		// Number of agents at v at time t
+		int count(uint32_t v, int t) const {
+			int n = 0;
+			auto it = occupied.find(key(v, t));
+			if (it != occupied.end()) {
+				n += int(it->second.size());
+			}
+			auto park = parked.find(v);
+			if (park != parked.end()) {
+				for (const std::pair<uint32_t, int>& p : park->second) {
+					n += p.second <= t;
+				}
+			}
+			return n;
+		}
+
+	}; // class PathTable
+
+	// Reusable space-time focal search for one agent; each thread owns one, so its node
+	// pool, hash table, and lists keep their memory from one search to the next
+	class LowLevelContext {
+	public:
+
+		// Space-time search node; its g_score is its time t
+		struct Node {
+
+			uint32_t v;
+
+			int t;
+
+			// Estimated time to goal
+			int h;
+
+			// Conflicts with other agents along the path to this node
+			int conflicts;
+
+			uint32_t parent;
+
+			bool closed;
+
+		}; // struct Node
+
+		std::vector<Node> nodes;
+
+		// Node of every (cell, time) generated
+		std::unordered_map<uint64_t, uint32_t> visited;
+
+		// Open nodes by f_score, and the open nodes with f_score at most the focal bound by
+		// number of conflicts
+		std::set<std::pair<int, uint32_t>> open;
+
+		std::set<std::tuple<int, int, uint32_t>> focal;
+
+		// Forbidden (cell, time) pairs of the agent being planned, and the cells it may not
+		// move to from each (cell, time)
+		std::unordered_set<uint64_t> vertex_constraints;
+
+		std::unordered_map<uint64_t, std::vector<uint32_t>> edge_constraints;
+
+		// Paths of every other agent
+		PathTable others;
+
+		// Counters since the context was last read by solve()
+		long long num_searches = 0;
+
+		long long num_expanded = 0;
+
+		double seconds = 0;
+
+		// Seconds spent on constraint tree nodes around the searches
+		double node_seconds = 0;
+
+	}; // class LowLevelContext
+
+
+// ---------- Member variables ----------
+
+	// Map shared by every agent
+	const Grid& grid;
+
+	// Start and goal cell of every agent
+	std::vector<uint32_t> starts;
+
+	std::vector<uint32_t> goals;
+
+	// Suboptimality bound; 1 for CBS
+	double weight;
+
+	// Number of threads expanding constraint tree nodes
+	unsigned num_threads;
+
+	// Most constraint tree nodes to generate before giving up
+	long long max_nodes;
+
+	// Time solve() gives up at, if has_deadline is set
+	std::chrono::steady_clock::time_point deadline;
+
+	bool has_deadline = false;
+
+	// Set if the last solve() gave up because it ran out of time
+	bool timed_out = false;
+
+	// Length of each agent's path at the root, where it ignores the other agents
+	std::vector<int> free_lengths;
+
+	// Every constraint tree node generated; a node's position is its id
+	std::vector<HighLevelNode> tree;
+
+	// One low-level search context per thread
+	std::vector<LowLevelContext> contexts;
+
+	Stats stats;
+
+	// Worker threads; worker t uses contexts[t], and the thread calling solve() is worker 0.
+	// Empty until the first batch that has work for more than one thread
+	std::vector<std::thread> workers;
+
+	// Guards the batch fields below; workers wait on work_ready for a new batch and solve()
+	// waits on work_done for the workers to finish one
+	std::mutex pool_mutex;
+
+	std::condition_variable work_ready;
+
+	std::condition_variable work_done;
+
+	// Batch being run: batch_task is run for every index below batch_count, and batch_next is
+	// the next index to hand out. batch_id goes up by one for each batch
+	std::function<void(size_t, LowLevelContext&)> batch_task;
+
+	size_t batch_count = 0;
+
+	std::atomic<size_t> batch_next{ 0 };
+
+	uint64_t batch_id = 0;
+
+	// Workers that have not finished the current batch yet
+	size_t batch_active = 0;
+
+	// Set by the destructor to make the workers exit
+	bool shutting_down = false;
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor; weight 1 runs CBS, and a larger weight runs ECBS with that suboptimality
+	// bound. num_threads 0 uses one thread per hardware thread. The search gives up after
+	// max_nodes_in constraint tree nodes
+	CBS(const Grid& grid_in, const std::vector<Coordinate>& starts_in, const std::vector<Coordinate>& goals_in,
+		double weight_in = 1.0, unsigned num_threads_in = 0, long long max_nodes_in = 100000)
+		: grid{ grid_in }, weight{ std::max(1.0, weight_in) }, num_threads{ num_threads_in },
+		max_nodes{ max_nodes_in } {
+		// Checks that every start and goal is walkable and that no two agents share one
+		bool valid = starts_in.size() == goals_in.size() && !starts_in.empty();
+		std::unordered_set<uint32_t> used_starts, used_goals;
+		for (size_t i = 0; valid && i < starts_in.size(); ++i) {
+			valid = grid.inBounds(starts_in[i]) && grid.inBounds(goals_in[i])
+				&& grid.isWalkable(grid.index(starts_in[i])) && grid.isWalkable(grid.index(goals_in[i]))
+				&& used_starts.insert(grid.index(starts_in[i])).second && used_goals.insert(grid.index(goals_in[i])).second;
+			if (valid) {
+				starts.push_back(grid.index(starts_in[i]));
+				goals.push_back(grid.index(goals_in[i]));
+			}
+		}
+		if (!valid) {
+			std::cerr << "Invalid start or goal coordinate\n";
+			exit(1);
+		}
+		if (num_threads == 0) {
+			num_threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		contexts.resize(num_threads);
+	} // CBS()
+
+	// Destructor; stops the worker threads
+	~CBS() {
+		{
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			shutting_down = true;
+		}
+		work_ready.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	} // ~CBS()
+
+	// Finds a path for every agent with no conflicts between them; the result has the cell of
+	// each agent at every time step until it reaches its goal, and num_v_explored counts
+	// low-level expansions. The result is empty if there is no solution within max_nodes
+	// constraint tree nodes or within max_seconds (if it is positive), and marked cancelled if
+	// cancel_in was set first
+	MultiPathResult solve(const CancelToken* cancel_in = nullptr, double max_seconds = 0) {
+		auto t_start = std::chrono::steady_clock::now();
+		has_deadline = max_seconds > 0;
+		deadline = t_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(max_seconds));
+		timed_out = false;
+		stats = Stats();
+		tree.clear();
+		for (LowLevelContext& context : contexts) {
+			context.num_searches = context.num_expanded = 0;
+			context.seconds = context.node_seconds = 0;
+		}
+		// Wall time spent waiting for parallel work, which the contexts account for
+		double parallel_seconds = 0;
+
+		// Open nodes by lower bound, nodes not yet in focal by cost, and focal nodes by number
+		// of conflicts; focal holds the open nodes whose cost is within weight times the
+		// lowest lower bound
+		std::set<std::pair<int, uint32_t>> open;
+		std::set<std::pair<int, uint32_t>> waiting;
+		std::set<std::tuple<int, int, uint32_t>> focal;
+		auto push = [&](HighLevelNode&& node) {
+			uint32_t id = uint32_t(tree.size());
+			open.insert({ node.lower_bound, id });
+			waiting.insert({ node.cost, id });
+			tree.push_back(std::move(node));
+			++stats.high_level_generated;
+		};
+		// Moves every node within the bound from waiting to focal
+		auto fillFocal = [&]() {
+			if (open.empty()) {
+				return;
+			}
+			int bound = int(weight * open.begin()->first);
+			while (!waiting.empty() && waiting.begin()->first <= bound) {
+				uint32_t id = waiting.begin()->second;
+				waiting.erase(waiting.begin());
+				focal.insert({ tree[id].num_conflicts, tree[id].cost, id });
+			}
+		};
+
+		// Plan every agent alone for the root
+		HighLevelNode root;
+		root.parent = SearchState::no_parent;
+		root.constraint = { 0, SearchState::no_parent, SearchState::no_parent, -1 };
+		root.paths.resize(starts.size());
+		root.lower_bounds.resize(starts.size());
+		std::vector<char> root_found(starts.size(), false);
+		parallel_seconds += runParallel(starts.size(), [&](size_t agent, LowLevelContext& context) {
+			Path path;
+			int lower_bound;
+			root_found[agent] = lowLevel(context, uint32_t(agent), {}, root.paths, path, lower_bound, true);
+			root.paths[agent] = std::make_shared<const Path>(std::move(path));
+			root.lower_bounds[agent] = lower_bound;
+		});
+		MultiPathResult result;
+		if (std::find(root_found.begin(), root_found.end(), false) == root_found.end()) {
+			free_lengths.clear();
+			for (const std::shared_ptr<const Path>& path : root.paths) {
+				free_lengths.push_back(int(path->size()) - 1);
+			}
+			finishNode(root);
+			push(std::move(root));
+		}
+
+		uint32_t solution = SearchState::no_parent;
+		std::vector<uint32_t> batch;
+		while (!open.empty() && stats.high_level_generated < max_nodes) {
+			if (isCancelled(cancel_in)) {
+				result.cancelled = true;
+				break;
+			}
+			if (pastDeadline()) {
+				break;
+			}
+			fillFocal();
+			// Take up to one node per thread from focal, stopping at a node without
+			// conflicts; it is the solution if it is the first node taken
+			batch.clear();
+			while (!focal.empty() && batch.size() < num_threads) {
+				uint32_t id = std::get<2>(*focal.begin());
+				if (tree[id].num_conflicts == 0 && !batch.empty()) {
+					break;
+				}
+				focal.erase(focal.begin());
+				open.erase({ tree[id].lower_bound, id });
+				batch.push_back(id);
+				if (tree[id].num_conflicts == 0) {
+					break;
+				}
+			}
+			if (batch.empty()) {
+				break;
+			}
+			if (tree[batch[0]].num_conflicts == 0) {
+				solution = batch[0];
+				break;
+			}
+
+			// Split each node in the batch into two children, in parallel
+			stats.high_level_expanded += batch.size();
+			std::vector<HighLevelNode> children(2 * batch.size());
+			std::vector<char> child_found(children.size(), false);
+			parallel_seconds += runParallel(children.size(), [&](size_t i, LowLevelContext& context) {
+				child_found[i] = makeChild(context, batch[i / 2], i % 2 == 1, children[i]);
+			});
+			for (size_t i = 0; i < children.size(); ++i) {
+				if (child_found[i]) {
+					push(std::move(children[i]));
+				}
+			}
+		}
+
+		// Low-level searches cut short by the deadline report no path, so check it once more
+		timed_out = solution == SearchState::no_parent && !result.cancelled && pastDeadline();
+		if (solution != SearchState::no_parent) {
+			for (const std::shared_ptr<const Path>& path : tree[solution].paths) {
+				std::vector<Coordinate> cells;
+				for (uint32_t v : *path) {
+					cells.push_back(grid.coord(v));
+				}
+				result.paths.push_back(std::move(cells));
+			}
+		}
+		for (const LowLevelContext& context : contexts) {
+			stats.low_level_searches += context.num_searches;
+			stats.low_level_expanded += context.num_expanded;
+			stats.low_level_seconds += context.seconds;
+			stats.high_level_seconds += context.node_seconds;
+		}
+		result.num_v_explored = int(std::min<long long>(stats.low_level_expanded, INT_MAX));
+		auto t_end = std::chrono::steady_clock::now();
+		stats.total_seconds = std::chrono::duration<double>(t_end - t_start).count();
+		stats.high_level_seconds += stats.total_seconds - parallel_seconds;
+		return result;
+	} // solve()
+
+	// Counters describing the last solve()
+	const Stats& lastStats() const {
+		return stats;
+	} // lastStats()
+
+	// True if the last solve() gave up because it ran out of time
+	bool timedOut() const {
+		return timed_out;
+	} // timedOut()
+
+private:
+
+	// Runs task(i, context) for every i below count on up to num_threads threads, each with
+	// its own low-level context; returns the wall time it took
+	template <typename Task>
+	double runParallel(size_t count, Task task) {
+		auto t_start = std::chrono::steady_clock::now();
+		if (num_threads == 1 || count <= 1) {
+			for (size_t i = 0; i < count; ++i) {
+				task(i, contexts[0]);
+			}
+		}
+		else {
+			if (workers.empty()) {
+				for (size_t t = 1; t < num_threads; ++t) {
+					workers.emplace_back(&CBS::workerLoop, this, t);
+				}
+			}
+			{
+				std::lock_guard<std::mutex> lock(pool_mutex);
+				batch_task = task;
+				batch_count = count;
+				batch_next = 0;
+				batch_active = workers.size();
+				++batch_id;
+			}
+			work_ready.notify_all();
+			runBatch(contexts[0]);
+			std::unique_lock<std::mutex> lock(pool_mutex);
+			work_done.wait(lock, [this]() { return batch_active == 0; });
+			batch_task = nullptr;
+		}
+		auto t_end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double>(t_end - t_start).count();
+	} // runParallel()
+
+	// Runs tasks of the current batch with context until none are left
+	void runBatch(LowLevelContext& context) {
+		for (size_t i = batch_next++; i < batch_count; i = batch_next++) {
+			batch_task(i, context);
+		}
+	} // runBatch()
+
+	// Body of worker thread t; runs its share of each batch until the CBS is destroyed
+	void workerLoop(size_t t) {
+		uint64_t last_batch = 0;
+		std::unique_lock<std::mutex> lock(pool_mutex);
+		while (true) {
+			work_ready.wait(lock, [&]() { return shutting_down || batch_id != last_batch; });
+			if (shutting_down) {
+				return;
+			}
+			last_batch = batch_id;
+			lock.unlock();
+			runBatch(contexts[t]);
+			lock.lock();
+			if (--batch_active == 0) {
+				work_done.notify_one();
+			}
+		}
+	} // workerLoop()
+
+	// Makes the child of node parent_id that constrains the second agent of its conflict if
+	// second is set, and the first otherwise; returns false if that agent has no path under
+	// the new constraint
+	bool makeChild(LowLevelContext& context, uint32_t parent_id, bool second, HighLevelNode& child) {
+		const HighLevelNode& parent = tree[parent_id];
+		const Conflict& conflict = parent.conflict;
+		if (conflict.to == SearchState::no_parent) {
+			child.constraint = { second ? conflict.b : conflict.a, conflict.v, SearchState::no_parent, conflict.t };
+		}
+		else if (!second) {
+			child.constraint = { conflict.a, conflict.v, conflict.to, conflict.t };
+		}
+		else {
+			child.constraint = { conflict.b, conflict.to, conflict.v, conflict.t };
+		}
+		child.parent = parent_id;
+		child.paths = parent.paths;
+		child.lower_bounds = parent.lower_bounds;
+
+		// Gather the agent's constraints from the new one up to the root
+		uint32_t agent = child.constraint.agent;
+		std::vector<Constraint> constraints = { child.constraint };
+		for (uint32_t id = parent_id; tree[id].parent != SearchState::no_parent; id = tree[id].parent) {
+			if (tree[id].constraint.agent == agent) {
+				constraints.push_back(tree[id].constraint);
+			}
+		}
+
+		Path path;
+		int lower_bound;
+		if (!lowLevel(context, agent, constraints, child.paths, path, lower_bound, false)) {
+			return false;
+		}
+		auto t_start = std::chrono::steady_clock::now();
+		child.paths[agent] = std::make_shared<const Path>(std::move(path));
+		child.lower_bounds[agent] = std::max(lower_bound, parent.lower_bounds[agent]);
+		finishNode(child);
+		auto t_end = std::chrono::steady_clock::now();
+		context.node_seconds += std::chrono::duration<double>(t_end - t_start).count();
+		return true;
+	} // makeChild()
+
+	// Fills in the cost, lower bound, and conflicts of a node from its paths
+	void finishNode(HighLevelNode& node) const {
+		node.cost = 0;
+		node.lower_bound = 0;
+		for (size_t agent = 0; agent < node.paths.size(); ++agent) {
+			node.cost += int(node.paths[agent]->size()) - 1;
+			node.lower_bound += node.lower_bounds[agent];
+		}
+		node.num_conflicts = findConflicts(node.paths, node.conflict);
+	} // finishNode()
+
+	// Returns the number of pairs of agents whose paths conflict, and sets first to the
+	// earliest conflict
+	int findConflicts(const std::vector<std::shared_ptr<const Path>>& paths, Conflict& first) const {
+		size_t horizon = 0;
+		for (const std::shared_ptr<const Path>& path : paths) {
+			horizon = std::max(horizon, path->size());
+		}
+		auto at = [&](uint32_t agent, size_t t) {
+			const Path& path = *paths[agent];
+			return t < path.size() ? path[t] : path.back();
+		};
+
+		std::set<std::pair<uint32_t, uint32_t>> conflicting;
+		first.t = INT_MAX;
+		auto record = [&](uint32_t a, uint32_t b, uint32_t v, uint32_t to, int t) {
+			conflicting.insert({ std::min(a, b), std::max(a, b) });
+			if (t < first.t) {
+				first = { a, b, v, to, t };
+			}
+		};
+		// Agent at every cell for the current time step
+		std::unordered_map<uint32_t, uint32_t> at_cell;
+		for (size_t t = 0; t < horizon; ++t) {
+			at_cell.clear();
+			for (uint32_t agent = 0; agent < paths.size(); ++agent) {
+				auto inserted = at_cell.insert({ at(agent, t), agent });
+				if (!inserted.second) {
+					record(inserted.first->second, agent, at(agent, t), SearchState::no_parent, int(t));
+				}
+			}
+			// Two agents swap cells if one moves into the cell the other is leaving for its own
+			for (uint32_t agent = 0; t + 1 < horizon && agent < paths.size(); ++agent) {
+				uint32_t from = at(agent, t), to = at(agent, t + 1);
+				auto other = at_cell.find(to);
+				if (from != to && other != at_cell.end() && other->second != agent && at(other->second, t + 1) == from
+					&& agent < other->second) {
+					record(agent, other->second, from, to, int(t));
+				}
+			}
+		}
+		return int(conflicting.size());
+	} // findConflicts()
+
+	// Finds a path for agent that obeys constraints, preferring paths with few conflicts with
+	// the other agents' paths; sets lower_bound to a lower bound on the length of any such path.
+	// Returns false if there is none. With no constraints the search is also allowed to ignore
+	// the other agents, as the root does
+	bool lowLevel(LowLevelContext& context, uint32_t agent, const std::vector<Constraint>& constraints,
+		const std::vector<std::shared_ptr<const Path>>& paths, Path& path, int& lower_bound, bool is_root) const {
+		auto t_start = std::chrono::steady_clock::now();
+		++context.num_searches;
+		context.nodes.clear();
+		context.visited.clear();
+		context.open.clear();
+		context.focal.clear();
+		context.vertex_constraints.clear();
+		context.edge_constraints.clear();
+		context.others.occupied.clear();
+		context.others.parked.clear();
+
+		// The agent may only stop at its goal after the last time it is forbidden from it
+		uint32_t start = starts[agent], goal = goals[agent];
+		int goal_after = 0;
+		int latest = 0;
+		for (const Constraint& c : constraints) {
+			if (c.to == SearchState::no_parent) {
+				context.vertex_constraints.insert(key(c.v, c.t));
+				if (c.v == goal) {
+					goal_after = std::max(goal_after, c.t + 1);
+				}
+			}
+			else {
+				context.edge_constraints[key(c.v, c.t)].push_back(c.to);
+			}
+			latest = std::max(latest, c.t);
+		}
+		if (!is_root) {
+			for (uint32_t other = 0; other < paths.size(); ++other) {
+				if (other == agent) {
+					continue;
+				}
+				const Path& other_path = *paths[other];
+				for (size_t t = 0; t + 1 < other_path.size(); ++t) {
+					context.others.occupied[key(other_path[t], int(t))].push_back(other);
+				}
+				context.others.parked[other_path.back()].push_back({ other, int(other_path.size()) - 1 });
+			}
+		}
+		// Any path can be cut at time latest, from some cell at most latest moves from start, and
+		// finished along a shortest path, which is at most latest moves back to start plus the
+		// length of the root path; so no path needs to run past this horizon
+		int horizon = is_root ? int(grid.size()) : 2 * latest + free_lengths[agent];
+		// Without constraints time does not matter, so states are cells as in plain A*
+		bool timed = !constraints.empty();
+		auto isMoveForbidden = [&](uint32_t v, uint32_t to, int t) {
+			auto it = context.edge_constraints.find(key(v, t));
+			return it != context.edge_constraints.end() && std::find(it->second.begin(), it->second.end(), to) != it->second.end();
+		};
+
+		auto at = [&](uint32_t other, int t) {
+			const Path& other_path = *paths[other];
+			return size_t(t) < other_path.size() ? other_path[t] : other_path.back();
+		};
+		auto generate = [&](uint32_t v, int t, int conflicts, uint32_t parent, int bound) {
+			auto found = context.visited.find(key(v, timed ? t : 0));
+			if (found != context.visited.end()) {
+				LowLevelContext::Node& node = context.nodes[found->second];
+				// Without time in the key a duplicate may reach the cell sooner; it then replaces
+				// the node, reopening it if it was closed, as in A*
+				if (t < node.t) {
+					if (!node.closed) {
+						context.open.erase({ node.t + node.h, found->second });
+						context.focal.erase({ node.conflicts, node.t + node.h, found->second });
+					}
+					node = { v, t, node.h, conflicts, parent, false };
+					context.open.insert({ t + node.h, found->second });
+					if (t + node.h <= bound) {
+						context.focal.insert({ conflicts, t + node.h, found->second });
+					}
+					return;
+				}
+				// Otherwise a duplicate only helps if it is as soon and has fewer conflicts
+				if (node.closed || t > node.t || node.conflicts <= conflicts) {
+					return;
+				}
+				int f = node.t + node.h;
+				if (f <= bound) {
+					context.focal.erase({ node.conflicts, f, found->second });
+					context.focal.insert({ conflicts, f, found->second });
+				}
+				node.conflicts = conflicts;
+				node.parent = parent;
+				return;
+			}
+			uint32_t id = uint32_t(context.nodes.size());
+			int h = distance(v, goal);
+			context.nodes.push_back({ v, t, h, conflicts, parent, false });
+			context.visited.insert({ key(v, timed ? t : 0), id });
+			context.open.insert({ t + h, id });
+			if (t + h <= bound) {
+				context.focal.insert({ conflicts, t + h, id });
+			}
+		};
+
+		bool found_path = false;
+		lower_bound = distance(start, goal);
+		int bound = int(weight * lower_bound);
+		if (context.vertex_constraints.count(key(start, 0)) == 0) {
+			generate(start, 0, 0, SearchState::no_parent, bound);
+		}
+		while (!context.open.empty()) {
+			// Raise the focal bound when the lowest f_score rises
+			int f_min = context.open.begin()->first;
+			lower_bound = std::max(lower_bound, f_min);
+			if (int(weight * f_min) > bound) {
+				int new_bound = int(weight * f_min);
+				for (auto it = context.open.upper_bound({ bound, UINT32_MAX });
+					it != context.open.end() && it->first <= new_bound; ++it) {
+					const LowLevelContext::Node& node = context.nodes[it->second];
+					context.focal.insert({ node.conflicts, it->first, it->second });
+				}
+				bound = new_bound;
+			}
+
+			// Give up once the time limit of solve() has passed
+			if ((context.num_expanded & 255) == 0 && pastDeadline()) {
+				break;
+			}
+			uint32_t id = std::get<2>(*context.focal.begin());
+			context.focal.erase(context.focal.begin());
+			LowLevelContext::Node node = context.nodes[id];
+			context.open.erase({ node.t + node.h, id });
+			context.nodes[id].closed = true;
+			++context.num_expanded;
+
+			if (node.v == goal && node.t >= goal_after) {
+				// Build the path from the chain of parents
+				path.clear();
+				for (uint32_t n = id; n != SearchState::no_parent; n = context.nodes[n].parent) {
+					path.push_back(context.nodes[n].v);
+				}
+				std::reverse(path.begin(), path.end());
+				found_path = true;
+				break;
+			}
+			if (node.t >= horizon) {
+				continue;
+			}
+
+			// Wait (only when time matters), or move to an adjacent walkable cell, unless forbidden
+			Coordinate loc = grid.coord(node.v);
+			uint32_t next[5] = { node.v, node.v, node.v, node.v, node.v };
+			int num_next = 1;
+			if (loc.row != 0) {
+				next[num_next++] = grid.above(node.v);
+			}
+			if (loc.row != grid.numRows() - 1) {
+				next[num_next++] = grid.below(node.v);
+			}
+			if (loc.col != 0) {
+				next[num_next++] = grid.left(node.v);
+			}
+			if (loc.col != grid.numCols() - 1) {
+				next[num_next++] = grid.right(node.v);
+			}
+			for (int i = 0; i < num_next; ++i) {
+				uint32_t adj_v = next[i];
+				int t = node.t + 1;
+				if ((i == 0 && !timed) || !grid.isWalkable(adj_v) || context.vertex_constraints.count(key(adj_v, t))
+					|| isMoveForbidden(node.v, adj_v, node.t)) {
+					continue;
+				}
+				int conflicts = node.conflicts;
+				if (!is_root) {
+					conflicts += context.others.count(adj_v, t);
+					// Count agents moving the other way along the same edge
+					auto swapping = context.others.occupied.find(key(adj_v, node.t));
+					if (adj_v != node.v && swapping != context.others.occupied.end()) {
+						for (uint32_t other : swapping->second) {
+							conflicts += at(other, t) == node.v;
+						}
+					}
+				}
+				generate(adj_v, t, conflicts, id, bound);
+			}
+		}
+
+		auto t_end = std::chrono::steady_clock::now();
+		context.seconds += std::chrono::duration<double>(t_end - t_start).count();
+		return found_path;
+	} // lowLevel()
+
+	// True if solve() has a time limit and it has passed
+	bool pastDeadline() const {
+		return has_deadline && std::chrono::steady_clock::now() >= deadline;
+	} // pastDeadline()
+
+	// Manhattan distance between two cells
+	int distance(uint32_t a, uint32_t b) const {
+		Coordinate loc_a = grid.coord(a);
+		Coordinate loc_b = grid.coord(b);
+		return abs(loc_a.row - loc_b.row) + abs(loc_a.col - loc_b.col);
+	} // distance()
+
+	// Key of cell v at time t in the hash tables
+	static uint64_t key(uint32_t v, int t) {
+		return uint64_t(uint32_t(t)) << 32 | v;
+	} // key()
+
+}; // class CBS
@@ -5,55 +5,63 @@
 #include <queue>
 #include <climits>
 #include "structs.h"
+#include "trace.h"
+#include "perf_counters.h"
 
 class Dijkstra {
 private: 
 
-	// Stores information needed for Dijkstra's algorithm for each vertex in map
-	struct Vertex {
-		
-		// Length of the shortest path from start
-		int path_length = INT_MAX;
-
-		// Location of the preceding vertex in the shortest path from start
-		Coordinate prev_vertex = { -1, -1 };
+	// Entry in pq; path_length is stored with the entry so the heap never reads a value that
+	// has changed since the entry was pushed
+	struct PQEntry {
 
-		// Stores indices of vertex in 2D vector vertices
-		Coordinate loc;
+		// Length of the path from start when the entry was pushed
+		int path_length;
 
-		// Stores type of vertex (walkable, obstacle, etc.)
-		Cell type;
+		// Index of the vertex in grid
+		uint32_t v;
 
-		// Whether the shortest path from start is known
-		bool path_known = false;
-	}; // class Vertex
+	}; // struct PQEntry
 
-	// Functor to compare two Vertex pointers; returns true if Vertex a's path_length is 
-	// less than Vertex b's path_length
+	// Functor to compare two pq entries; returns true if entry a's path_length is 
+	// greater than entry b's path_length
 	class PathComp {
 	public: 
 
-		bool operator()(const Vertex* a, const Vertex* b) {
-			return a->path_length > b->path_length;
+		bool operator()(const PQEntry& a, const PQEntry& b) {
+			return a.path_length > b.path_length;
 		}
 	}; // class PathComp
 
 // ---------- Member variables ----------
 
-	// Stores information for Dijkstra's about each location in map
-	std::vector<std::vector<Vertex>> vertices;
+	// Map shared with the other planners; vertex types are read from here
+	const Grid& grid;
+
+	// Parent index, shortest known path length (g_score), and path_known flag (closed) of
+	// every vertex in the map
+	SearchState state;
 
-	// Used for printing the path
+	// Used for printing the path; filled in by reconstructPath()
 	std::vector<std::vector<Cell>> map;
 
 	// Min path_length priority queue for Dijkstra's algorithm; Vertex with lowest path_length
 	// have highest priority
-	std::priority_queue<Vertex*, std::vector<Vertex*>, PathComp> pq;
+	std::priority_queue<PQEntry, std::vector<PQEntry>, PathComp> pq;
 	
-	// Dijkstra's will find the shortest path between these two locations 
+	// Finds the shortest path between start and the nearest of goals
 	Coordinate start;
-	
-	Coordinate goal;
+
+	std::vector<Coordinate> goals;
+
+	// Number of goals to settle before the search stops; 0 settles every reachable vertex
+	size_t max_goals;
+
+	// Indices of the goals reached so far, in the order they were reached
+	std::vector<uint32_t> reached;
+
+	// Set by plan(); search() gives up as soon as it is cancelled
+	const CancelToken* cancel = nullptr;
 
 	// Number of vertices explored
 	int num_v_explored = 0;
@@ -66,26 +74,28 @@ public:
 // ---------- Member functions ----------
 
 	// Constructor
-	Dijkstra(const std::vector<std::vector<Cell>>& map_in, const Coordinate& start_in,
-		const Coordinate& goal_in)
-		: map{ map_in }, start{ start_in }, goal{ goal_in } { 
-		// Checks that both start and goal are walkable spaces
-		if (map_in[start.row][start.col] != Cell::start || map_in[goal.row][goal.col] != Cell::goal) {
+	Dijkstra(const Grid& grid_in, const Coordinate& start_in, const Coordinate& goal_in)
+		: Dijkstra(grid_in, start_in, std::vector<Coordinate>{ goal_in }, 0) {}
+
+	// Searches from start toward several goals at once and stops after max_goals of them
+	// have been settled (0 settles every reachable vertex, which is what the single-goal
+	// constructor does); plan() then returns the path to the nearest goal and planGoals() the
+	// paths to every goal reached
+	Dijkstra(const Grid& grid_in, const Coordinate& start_in,
+		const std::vector<Coordinate>& goals_in, size_t max_goals_in = 1)
+		: grid{ grid_in }, state{ grid_in.size(), true },
+		start{ start_in }, goals{ goals_in }, max_goals{ max_goals_in } {
+		// Checks that start and every goal are walkable spaces
+		bool valid = grid.isWalkable(grid.index(start)) && !goals.empty();
+		for (const Coordinate& goal : goals) {
+			valid = valid && grid.isWalkable(grid.index(goal));
+		}
+		if (!valid) {
 			std::cerr << "Invalid start or goal coordinate\n";
 			exit(1);
 		}
-
-		// Initializes vertices to be the same size as map_in
-		size_t rows = map_in.size();
-		size_t cols = map_in[0].size();
-		vertices = std::vector<std::vector<Vertex>>(rows, std::vector<Vertex>(cols));
-
-		// Gives each vertex the correct type and location
-		for (int i = 0; i < rows; ++i) {
-			for (int j = 0; j < cols; ++j) {
-				vertices[i][j].loc = { i, j };
-				vertices[i][j].type = map_in[i][j];
-			}
+		for (const Coordinate& goal : goals) {
+			state.set(grid.index(goal), SearchState::goal);
 		}
 	} // Dijkstra()
 
@@ -93,31 +103,87 @@ public:
 	// Uses Dijkstra's algorithm to find the shortest path between start and goal; changes
 	// type of each Vertex in that path to "path"
 	std::vector<std::vector<Cell>> findPath() { 
+		search();
+		// Backtrack from goal to find the shortest path between start and goal
+		reconstructPath();
+		// Print data describing path
+		printData();
+
+		return map;
+	} // findPath()
+
+	// Same as findPath(), but prints nothing and returns the cells of the path instead of
+	// a map; the search gives up early if cancel_in is set
+	PathResult plan(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search()) {
+			return { {}, num_v_explored, true };
+		}
+		PerfScope perf_scope(PerfPhase::reconstruct);
+		return { state.extractPath(grid, grid.index(start), firstGoal()), num_v_explored };
+	} // plan()
+
+	// Same as plan(), but returns the paths to every goal reached, all taken from the same
+	// search tree
+	MultiPathResult planGoals(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search()) {
+			return { {}, num_v_explored, true };
+		}
+		MultiPathResult result{ {}, num_v_explored };
+		for (uint32_t v_goal : reached) {
+			result.paths.push_back(state.extractPath(grid, grid.index(start), v_goal));
+		}
+		return result;
+	} // planGoals()
+
+	// Runs the search without printing anything and returns the length of the shortest path
+	// from start to every vertex, or INT_MAX for vertices it cannot reach
+	const std::vector<int>& distances(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		search();
+		return state.g_score;
+	} // distances()
+
+private:
+
+	// Runs Dijkstra's algorithm until max_goals goals are settled or pq is empty; returns false
+	// if it was cancelled first
+	bool search() {
+		PerfScope perf_scope(PerfPhase::search);
 		// Set start vertex's path_length to 0 and add it to pq
-		vertices[start.row][start.col].path_length = 0;
-		pq.push(&vertices[start.row][start.col]);
+		uint32_t v_start = grid.index(start);
+		state.g_score[v_start] = 0;
+		pq.push({ 0, v_start });
+		TRACE_SEARCH(begin, v_start, 0, 0);
 
 		while (!pq.empty()) {
+			// Stop early if the search has been cancelled
+			if (isCancelled(cancel)) {
+				return false;
+			}
 			// Get vertex with smallest path_length out of the pq
-			Vertex* min_v = pq.top();
+			uint32_t min_v = pq.top().v;
+			TRACE_SEARCH(pop, min_v, pq.top().path_length, pq.top().path_length);
 			pq.pop();
 			// If the shortest path from start to min_v is not known yet and min_v is walkable
-			if (!min_v->path_known && isWalkable(min_v)) {
-				min_v->path_known = true;
+			if (!state.test(min_v, SearchState::closed) && grid.isWalkable(min_v)) {
+				state.set(min_v, SearchState::closed);
+				TRACE_SEARCH(expand, min_v, state.g_score[min_v], state.g_score[min_v]);
+				// The shortest path to a goal is known once it is settled; stop once enough
+				// goals have been reached
+				if (state.test(min_v, SearchState::goal)) {
+					reached.push_back(min_v);
+					if (reached.size() == max_goals) {
+						break;
+					}
+				}
 				// Update the path_length of adjacent vertices and add new vertices to pq
 				updateAdj(min_v);
 			}
 		}
-
-		// Backtrack from goal to find the shortest path between start and goal
-		reconstructPath();
-		// Print data describing path
-		printData();
-
-		return map;
-	}
-
-private:
+		return true;
+	} // search()
 	
 	// Prints out data describing path
 	void printData() const {
@@ -128,69 +194,69 @@ private:
 
 	// Updates the path_length of all vertices adjacent to given vertex and adds new vertices
 	// to pq
-	void updateAdj(Vertex* v) {
+	void updateAdj(uint32_t v) {
 		// Calculate new path length coming from v
-		int new_path_len = v->path_length + 1;
+		int new_path_len = state.g_score[v] + 1;
+		Coordinate loc = grid.coord(v);
 		// Check for out of bounds indexing
-		if (v->loc.row != 0) {
-			Vertex* v_up = &(vertices[v->loc.row - 1][v->loc.col]);
-			updateV(v, v_up, new_path_len);
+		if (loc.row != 0) {
+			updateV(v, grid.above(v), new_path_len);
 		}
 		
 		// Repeat above process vertices below, left, and right
-		if (v->loc.row != vertices.size() - 1) {
-			Vertex* v_down = &(vertices[v->loc.row + 1][v->loc.col]);
-			updateV(v, v_down, new_path_len);
+		if (loc.row != grid.numRows() - 1) {
+			updateV(v, grid.below(v), new_path_len);
 		}
 
-		if (v->loc.col != vertices[0].size() - 1) {
-			Vertex* v_right = &(vertices[v->loc.row][v->loc.col + 1]);
-			updateV(v, v_right, new_path_len);
+		if (loc.col != grid.numCols() - 1) {
+			updateV(v, grid.right(v), new_path_len);
 		}
 
-		if (v->loc.col != 0) {
-			Vertex* v_left = &(vertices[v->loc.row][v->loc.col - 1]);
-			updateV(v, v_left, new_path_len);
+		if (loc.col != 0) {
+			updateV(v, grid.left(v), new_path_len);
 		}
 	} // updateAdj()
 
 	// Helper function for updateAdj()
-	void updateV(Vertex* v, Vertex* curr_v, int new_path_len) {
+	void updateV(uint32_t v, uint32_t curr_v, int new_path_len) {
 		// If curr_v is walkable and new_path_len is less than curr_v's path length, update 
-		// curr_v's path length and prev vertex, and push it into pq
-		if (isWalkable(curr_v)) {
+		// curr_v's path length and parent, and push it into pq
+		if (grid.isWalkable(curr_v)) {
 			++num_v_explored;
-			if (new_path_len < curr_v->path_length) {
-				curr_v->path_length = new_path_len;
-				curr_v->prev_vertex = v->loc;
-				pq.push(curr_v);
+			if (new_path_len < state.g_score[curr_v]) {
+				state.g_score[curr_v] = new_path_len;
+				state.parent[curr_v] = v;
+				pq.push({ new_path_len, curr_v });
+				TRACE_SEARCH(push, curr_v, new_path_len, new_path_len);
 			}
 		}
 	}
 
+	// Index of the first goal reached, or of the first goal if none was reached
+	uint32_t firstGoal() const {
+		return reached.empty() ? grid.index(goals[0]) : reached[0];
+	} // firstGoal()
+
 	// Backtrack from goal to find the shortest path between start and goal; sets the type of
 	// each vertex in the path equal to "path"
 	void reconstructPath() {
-		Vertex* v_goal = &(vertices[goal.row][goal.col]);
-		Coordinate v_path = v_goal->prev_vertex;
+		PerfScope perf_scope(PerfPhase::reconstruct);
+		map = grid.toMap();
+		uint32_t v_start = grid.index(start);
+		uint32_t v_path = state.parent[firstGoal()];
 		++total_path_length;
-		while (!(v_path == start)) {
-			if (v_path == Coordinate{ -1, -1 }) {
+		while (v_path != v_start) {
+			if (v_path == SearchState::no_parent) {
 				std::cout << "No path found\n";
 				total_path_length = 0;
 				break;
 			}
-			map[v_path.row][v_path.col] = Cell::path;
-			Vertex* v = &(vertices[v_path.row][v_path.col]);
-			v_path = v->prev_vertex;
+			Coordinate loc = grid.coord(v_path);
+			map[loc.row][loc.col] = Cell::path;
+			v_path = state.parent[v_path];
 			++total_path_length;
 		}
 	} // reconstructPath()
 
-	// Returns true if a given vertex is either walkable, start, or goal
-	bool isWalkable(Vertex* v) {
-		return v->type == Cell::walkable || v->type == Cell::start || v->type == Cell::goal;
-	} // isWalkable()
-
 
 }; // class Dijkstra
\ No newline at end of file
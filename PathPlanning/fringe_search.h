@@ -0,0 +1,386 @@
+#pragma once
+
+#include <vector>
+#include <climits>
+#include <algorithm>
+#include "structs.h"
+
+
+// Implementation of Fringe Search; like A* with the same heuristic, it finds the shortest path,
+// but it keeps its fringe in two plain lists (now and later) instead of a priority queue, so it
+// does no heap maintenance. Vertices whose f_score is within the current threshold are expanded
+// depth first from now; the rest wait in later until the threshold is raised to the smallest
+// f_score that was deferred. With a memory limit, the state of each vertex is kept in a hash
+// table of only the vertices reached, which grows as long as it fits in the limit, instead of in
+// arrays with an entry per cell
+class FringeSearch {
+private:
+
+	// Hash table entry; state of one reached vertex when there is a memory limit
+	struct TableEntry {
+
+		// Index of the vertex in grid; no_parent if the entry is empty
+		uint32_t v = SearchState::no_parent;
+
+		uint32_t parent = SearchState::no_parent;
+
+		int g_score = INT_MAX;
+
+		bool in_open = false;
+
+	}; // struct TableEntry
+
+	// Number of entries the hash table starts with, unless the memory limit is lower
+	static constexpr size_t initial_table_size = 64;
+
+// ---------- Member variables ----------
+
+	// Map shared with the other planners; vertex types are read from here
+	const Grid& grid;
+
+	// Parent index, g_score, and in_open flag of every vertex in the map; in_open is set while
+	// a vertex is part of the fringe. Empty if there is a memory limit
+	SearchState state;
+
+	// State of every vertex reached if there is a memory limit; its size is a power of two,
+	// and it is kept at most half full
+	std::vector<TableEntry> table;
+
+	// Number of vertices in table
+	size_t table_used = 0;
+
+	// Used for printing the path; filled in by reconstructPath()
+	std::vector<std::vector<Cell>> map;
+
+	// Vertices to visit in the current iteration; used as a stack
+	std::vector<uint32_t> now;
+
+	// Vertices whose f_score was over the threshold, to visit in the next iteration
+	std::vector<uint32_t> later;
+
+	// Finds the shortest path between these two vertices
+	Coordinate start;
+
+	Coordinate goal;
+
+	// Maximum number of bytes the search may use for its state and lists; 0 means no limit
+	size_t memory_limit;
+
+	// Largest number of bytes used at once by the search state and lists
+	size_t peak_memory = 0;
+
+	// Set if the search gave up because it would have needed more than memory_limit bytes
+	bool memory_exceeded = false;
+
+	// Set by plan(); search() gives up as soon as it is cancelled
+	const CancelToken* cancel = nullptr;
+
+	// Number of vertices explored
+	int num_v_explored = 0;
+
+	// Length of path
+	int total_path_length = 0;
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor; memory_limit_in is the most bytes the search may use, or 0 for no limit
+	FringeSearch(const Grid& grid_in, const Coordinate& start_in, const Coordinate& goal_in,
+		size_t memory_limit_in = 0)
+		: grid{ grid_in }, state{ memory_limit_in == 0 ? grid_in.size() : 0, true },
+		start{ start_in }, goal{ goal_in }, memory_limit{ memory_limit_in } {
+		// Checks that start and goal are walkable spaces
+		if (!grid.isWalkable(grid.index(start)) || !grid.isWalkable(grid.index(goal))) {
+			std::cerr << "Invalid start or goal coordinate\n";
+			exit(1);
+		}
+	} // FringeSearch()
+
+	// Uses Fringe Search to find the shortest path between start and goal
+	std::vector<std::vector<Cell>> findPath() {
+		search();
+		// Backtrack from goal to start to find the shortest path between start and goal
+		reconstructPath();
+		// Print data describing path
+		printData();
+
+		return map;
+	} // findPath()
+
+	// Same as findPath(), but prints nothing and returns the cells of the path instead of
+	// a map; the search gives up early if cancel_in is set
+	PathResult plan(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search()) {
+			return { {}, num_v_explored, true };
+		}
+		PathResult result{ {}, num_v_explored };
+		if (memory_exceeded) {
+			return result;
+		}
+		uint32_t v_start = grid.index(start);
+		for (uint32_t v = grid.index(goal); v != v_start; v = parentOf(v)) {
+			if (v == SearchState::no_parent) {
+				result.path.clear();
+				return result;
+			}
+			result.path.push_back(grid.coord(v));
+		}
+		result.path.push_back(start);
+		std::reverse(result.path.begin(), result.path.end());
+		return result;
+	} // plan()
+
+	// Largest number of bytes used at once by the search state and lists
+	size_t peakMemory() const {
+		return peak_memory;
+	} // peakMemory()
+
+	// True if the search gave up because it would have exceeded its memory limit
+	bool memoryExceeded() const {
+		return memory_exceeded;
+	} // memoryExceeded()
+
+private:
+
+	// Runs Fringe Search until goal is reached, the fringe is empty, or the memory limit is
+	// hit; returns false if it was cancelled first
+	bool search() {
+		uint32_t v_start = grid.index(start);
+		uint32_t v_goal = grid.index(goal);
+		if (memory_limit != 0) {
+			// Start smaller if the limit is too low for the usual initial size
+			size_t table_size = initial_table_size;
+			while (table_size > 2 && table_size * sizeof(TableEntry) > memory_limit / 2) {
+				table_size /= 2;
+			}
+			table.resize(table_size);
+		}
+		if (!updateMemory() || !reach(v_start, SearchState::no_parent, 0)) {
+			return true;
+		}
+		now.push_back(v_start);
+		int f_limit = calculateH(v_start);
+
+		while (!now.empty()) {
+			// Smallest f_score that was over f_limit in this iteration
+			int f_min = INT_MAX;
+			while (!now.empty()) {
+				// Stop early if the search has been cancelled
+				if (isCancelled(cancel)) {
+					return false;
+				}
+				uint32_t v = now.back();
+				now.pop_back();
+				// Skip stale entries for vertices that were already visited through a newer entry
+				if (!inOpen(v)) {
+					continue;
+				}
+				int f_score = gScore(v) + calculateH(v);
+				// Defer v to the next iteration if it is over the threshold
+				if (f_score > f_limit) {
+					f_min = std::min(f_min, f_score);
+					later.push_back(v);
+					continue;
+				}
+				// With a consistent heuristic, goal is only reached within the threshold by a
+				// shortest path
+				if (v == v_goal) {
+					return true;
+				}
+				close(v);
+				updateAdj(v);
+				if (!updateMemory()) {
+					return true;
+				}
+			}
+			// Raise the threshold and visit the deferred vertices; later is reversed so they
+			// are visited in the order they were deferred
+			f_limit = f_min;
+			std::reverse(later.begin(), later.end());
+			std::swap(now, later);
+		}
+		return true;
+	} // search()
+
+	// Estimates the cost to get from v to goal
+	int calculateH(uint32_t v) {
+		Coordinate loc = grid.coord(v);
+		int x_dist = abs(goal.col - loc.col);
+		int y_dist = abs(goal.row - loc.row);
+		return x_dist + y_dist;
+	} // calculateH()
+
+
+	void updateAdj(uint32_t v) {
+		// New g_score for each adjacent vertex
+		int new_g_score = gScore(v) + 1;
+		Coordinate loc = grid.coord(v);
+
+		// Neighbors are pushed in reverse order so that now pops them above, below, left,
+		// right, like the other planners
+		// Right vertex
+		// Check for out of bounds indexing
+		if (loc.col != grid.numCols() - 1) {
+			updateV(v, grid.right(v), new_g_score);
+		}
+
+		// Left vertex
+		if (loc.col != 0) {
+			updateV(v, grid.left(v), new_g_score);
+		}
+
+		// Below vertex
+		if (loc.row != grid.numRows() - 1) {
+			updateV(v, grid.below(v), new_g_score);
+		}
+
+		// Above vertex
+		if (loc.row != 0) {
+			updateV(v, grid.above(v), new_g_score);
+		}
+	} // updateAdj()
+
+	// Helper function for updateAdj()
+	void updateV(uint32_t v, uint32_t adj_v, int new_g_score) {
+		// If adj_v is walkable and new_g_score improves on the best known path to adj_v, add
+		// adj_v to the fringe right after v, replacing any entry it already had
+		if (grid.isWalkable(adj_v) && new_g_score < gScore(adj_v) && reach(adj_v, v, new_g_score)) {
+			++num_v_explored;
+			now.push_back(adj_v);
+		}
+	} // updateV()
+
+	// Position of the entry of v in table, or of the empty entry where it would go
+	size_t tableIndex(uint32_t v) const {
+		size_t mask = table.size() - 1;
+		size_t i = size_t(v * 2654435761u) & mask;
+		while (table[i].v != v && table[i].v != SearchState::no_parent) {
+			i = (i + 1) & mask;
+		}
+		return i;
+	} // tableIndex()
+
+	// Cost to get from start to v found so far; INT_MAX if v has not been reached
+	int gScore(uint32_t v) const {
+		return memory_limit == 0 ? state.g_score[v] : table[tableIndex(v)].g_score;
+	} // gScore()
+
+	// Index of the vertex v was last reached from
+	uint32_t parentOf(uint32_t v) const {
+		return memory_limit == 0 ? state.parent[v] : table[tableIndex(v)].parent;
+	} // parentOf()
+
+	// True if v is part of the fringe
+	bool inOpen(uint32_t v) const {
+		return memory_limit == 0 ? state.test(v, SearchState::in_open) : table[tableIndex(v)].in_open;
+	} // inOpen()
+
+	// Takes v out of the fringe
+	void close(uint32_t v) {
+		if (memory_limit == 0) {
+			state.reset(v, SearchState::in_open);
+		}
+		else {
+			table[tableIndex(v)].in_open = false;
+		}
+	} // close()
+
+	// Records that v was reached from parent with g_score and adds it to the fringe; returns
+	// false and sets memory_exceeded if the table would have to grow past memory_limit
+	bool reach(uint32_t v, uint32_t parent, int g_score) {
+		if (memory_limit == 0) {
+			state.g_score[v] = g_score;
+			state.parent[v] = parent;
+			state.set(v, SearchState::in_open);
+			return true;
+		}
+		size_t i = tableIndex(v);
+		if (table[i].v == SearchState::no_parent) {
+			if (2 * (table_used + 1) > table.size()) {
+				// Check the limit before allocating the larger table, which exists alongside
+				// the old one while entries are moved
+				if (memoryInUse() + 2 * table.size() * sizeof(TableEntry) > memory_limit) {
+					memory_exceeded = true;
+					return false;
+				}
+				growTable();
+				i = tableIndex(v);
+			}
+			++table_used;
+		}
+		table[i] = { v, parent, g_score, true };
+		return true;
+	} // reach()
+
+	// Doubles the size of table
+	void growTable() {
+		std::vector<TableEntry> old_table;
+		std::swap(table, old_table);
+		table.resize(2 * old_table.size());
+		peak_memory = std::max(peak_memory, memoryInUse() + old_table.capacity() * sizeof(TableEntry));
+		for (const TableEntry& entry : old_table) {
+			if (entry.v != SearchState::no_parent) {
+				table[tableIndex(entry.v)] = entry;
+			}
+		}
+	} // growTable()
+
+	// Bytes in use by the search state and lists
+	size_t memoryInUse() const {
+		return state.parent.capacity() * sizeof(uint32_t) + state.g_score.capacity() * sizeof(int)
+			+ state.flags.capacity() + table.capacity() * sizeof(TableEntry)
+			+ (now.capacity() + later.capacity()) * sizeof(uint32_t);
+	} // memoryInUse()
+
+	// Records the bytes in use by the search state and lists; returns false and sets
+	// memory_exceeded if they are over memory_limit
+	bool updateMemory() {
+		size_t bytes = memoryInUse();
+		peak_memory = std::max(peak_memory, bytes);
+		if (memory_limit != 0 && bytes > memory_limit) {
+			memory_exceeded = true;
+		}
+		return !memory_exceeded;
+	} // updateMemory()
+
+	// Backtrack from goal to find the shortest path between start and goal; sets the type of
+	// each vertex in the path equal to "path"
+	void reconstructPath() {
+		map = grid.toMap();
+		// A search that ran out of memory may have reached goal by a longer path; report
+		// no path rather than a path that might not be the shortest
+		if (memory_exceeded) {
+			std::cout << "No path found\n";
+			return;
+		}
+		uint32_t v_start = grid.index(start);
+		uint32_t v_path = parentOf(grid.index(goal));
+		++total_path_length;
+		while (v_path != v_start) {
+			if (v_path == SearchState::no_parent) {
+				std::cout << "No path found\n";
+				total_path_length = 0;
+				break;
+			}
+			Coordinate loc = grid.coord(v_path);
+			map[loc.row][loc.col] = Cell::path;
+			v_path = parentOf(v_path);
+			++total_path_length;
+		}
+	} // reconstructPath()
+
+	// Prints out data describing path
+	void printData() const {
+		std::cout << "Fringe search path \n";
+		if (memory_exceeded) {
+			std::cout << "Memory limit exceeded\n";
+		}
+		std::cout << "Cells examined: " << num_v_explored << "\n";
+		std::cout << "Path length: " << total_path_length << "\n";
+		std::cout << "Peak memory: " << peak_memory << " bytes\n\n";
+	} // printData()
+
+
+}; // class FringeSearch
@@ -8,53 +8,51 @@
 class GreedyBestFS {
 private:
 
-	struct Vertex {
-
-		// Location of the preceding vertex in the path in vertices
-		Coordinate prev_vertex = { -1, -1 };
-
-		// Location of vertex in vertices
-		Coordinate loc;
+	// Entry in open_list
+	struct OpenEntry {
 
 		// Estimate of the distance to the goal
-		int h_score = INT_MAX;
-
-		// Stores type of vertex 
-		Cell type;
+		int h_score;
 
-		// Set to true when vertex is placed into open list
-		bool in_open = false;
+		// Index of the vertex in grid
+		uint32_t v;
 
-	}; // Vertex struct
+	}; // OpenEntry struct
 
 
-	// Functor to compare two Vertex pointers; returns true if Vertex a's h is greater
-	// than Vertex b's h
+	// Functor to compare two open list entries; returns true if entry a's h is greater
+	// than entry b's h
 	class HComp {
 	public:
 
-		bool operator()(const Vertex* a, const Vertex* b) {
-			return a->h_score > b->h_score;
+		bool operator()(const OpenEntry& a, const OpenEntry& b) {
+			return a.h_score > b.h_score;
 		}
 	}; // class HComp
 
 
 // ---------- Member variables ----------
 
-	// Stores all the vertices in the map
-	std::vector<std::vector<Vertex>> vertices;
+	// Map shared with the other planners; vertex types are read from here
+	const Grid& grid;
 
-	// Used for printing the path
+	// Parent index and in_open flag of every vertex in the map
+	SearchState state;
+
+	// Used for printing the path; filled in by reconstructPath()
 	std::vector<std::vector<Cell>> map;
 
 	// Min h_score priority queue containing vertices that have been visited
-	std::priority_queue<Vertex*, std::vector<Vertex*>, HComp> open_list;
+	std::priority_queue<OpenEntry, std::vector<OpenEntry>, HComp> open_list;
 
 	// Finds the shortest path between these two vertices
 	Coordinate start;
 
 	Coordinate goal;
 
+	// Set by plan(); search() gives up as soon as it is cancelled
+	const CancelToken* cancel = nullptr;
+
 	// Number of vertices explored
 	int num_v_explored = 0;
 
@@ -66,117 +64,117 @@ public:
 // ---------- Member functions ----------
 
 	// Constructor
-	GreedyBestFS(const std::vector<std::vector<Cell>>& map_in, const Coordinate& start_in,
-		const Coordinate& goal_in) 
-		: map{ map_in }, start{ start_in }, goal{ goal_in } {
+	GreedyBestFS(const Grid& grid_in, const Coordinate& start_in, const Coordinate& goal_in) 
+		: grid{ grid_in }, state{ grid_in.size(), false },
+		start{ start_in }, goal{ goal_in } {
 		// Checks that start and goal are walkable spaces
-		if (map_in[start.row][start.col] != Cell::start || map_in[goal.row][goal.col] != Cell::goal) {
+		if (!grid.isWalkable(grid.index(start)) || !grid.isWalkable(grid.index(goal))) {
 			std::cerr << "Invalid start or goal coordinate\n";
 			exit(1);
 		}
-
-		// Initializes vertices to be the same size as map_in
-		size_t rows = map_in.size();
-		size_t cols = map_in[0].size();
-		vertices = std::vector<std::vector<Vertex>>(rows, std::vector<Vertex>(cols));
-
-		// Gives each vertex the correct type and location
-		for (int i = 0; i < rows; ++i) {
-			for (int j = 0; j < cols; ++j) {
-				vertices[i][j].loc = { i, j };
-				vertices[i][j].type = map_in[i][j];
-			}
-		}
 	} // GreedyBestFS()
 
 
 	// Uses greedy best-first search algorithm to find the shortest path between start and goal
 	std::vector<std::vector<Cell>> findPath() {
+		search();
+		// Backtrack from goal to start to find the shortest path between start and goal
+		reconstructPath();
+		// Print data describing path
+		printData();
+
+		return map;
+	} // findPath()
+
+	// Same as findPath(), but prints nothing and returns the cells of the path instead of
+	// a map; the search gives up early if cancel_in is set
+	PathResult plan(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search()) {
+			return { {}, num_v_explored, true };
+		}
+		return { state.extractPath(grid, grid.index(start), grid.index(goal)), num_v_explored };
+	} // plan()
+
+private:
+
+	// Runs greedy best-first search until goal is popped or open_list is empty; returns false
+	// if it was cancelled first
+	bool search() {
 		// Insert start vertex into open list
-		Vertex* start_v = &(vertices[start.row][start.col]);
-		open_list.push(start_v);
-		start_v->in_open = true;
+		uint32_t start_v = grid.index(start);
+		uint32_t v_goal = grid.index(goal);
+		open_list.push({ calculateH(start_v), start_v });
+		state.set(start_v, SearchState::in_open);
 
 		while (!open_list.empty()) {
+			// Stop early if the search has been cancelled
+			if (isCancelled(cancel)) {
+				return false;
+			}
 			// Get vertex with minimum h_score out of open_list
-			Vertex* curr_v = open_list.top();
+			uint32_t curr_v = open_list.top().v;
 			open_list.pop();
 			// If curr_v is the goal, break out of the while loop
-			if (curr_v->loc == goal) {
+			if (curr_v == v_goal) {
 				break;
 			}
 			// Update adjacent vertices h_scores and push them into open_list
 			updateAdj(curr_v);
 		}
-		// Backtrack from goal to start to find the shortest path between start and goal
-		reconstructPath();
-		// Print data describing path
-		printData();
-
-		return map;
-	} // findPath()
-
-private:
+		return true;
+	} // search()
 
 	// Estimates the cost to get from v to goal
-	int calculateH(Vertex* v) {
-		Vertex* v_goal = &(vertices[goal.row][goal.col]);
-		int x_dist = abs(v_goal->loc.col - v->loc.col);
-		int y_dist = abs(v_goal->loc.row - v->loc.row);
+	int calculateH(uint32_t v) {
+		Coordinate loc = grid.coord(v);
+		int x_dist = abs(goal.col - loc.col);
+		int y_dist = abs(goal.row - loc.row);
 		return x_dist + y_dist;
 	} // calculateH()
 
 
-	void updateAdj(Vertex* v) {
+	void updateAdj(uint32_t v) {
+		Coordinate loc = grid.coord(v);
+
 		// Above vertex
 		// Check for out of bounds indexing
-		if (v->loc.row != 0) {
-			Vertex* v_up = &(vertices[v->loc.row - 1][v->loc.col]);
+		if (loc.row != 0) {
 			// Calculates v_up's h_score and pushes it into open_list
-			updateV(v, v_up);
+			updateV(v, grid.above(v));
 		}
 
 		// Below vertex
-		if (v->loc.row != vertices.size() - 1) {
-			Vertex* v_down = &(vertices[v->loc.row + 1][v->loc.col]);
-			updateV(v, v_down);
+		if (loc.row != grid.numRows() - 1) {
+			updateV(v, grid.below(v));
 		}
 
 		// Left vertex
-		if (v->loc.col != 0) {
-			Vertex* v_left = &(vertices[v->loc.row][v->loc.col - 1]);
-			updateV(v, v_left);
+		if (loc.col != 0) {
+			updateV(v, grid.left(v));
 		}
 
 		// Right vertex
-		if (v->loc.col != vertices[0].size() - 1) {
-			Vertex* v_right = &(vertices[v->loc.row][v->loc.col + 1]);
-			updateV(v, v_right);
+		if (loc.col != grid.numCols() - 1) {
+			updateV(v, grid.right(v));
 		}
 	} // updateAdj()
 
 
 	// Helper function for updateAdj()
-	void updateV(Vertex* src_v, Vertex* adj_v) {
+	void updateV(uint32_t src_v, uint32_t adj_v) {
 		// Check if adj_v is walkable and not in open_list already
-		if (isWalkable(adj_v) && !adj_v->in_open) {
+		if (grid.isWalkable(adj_v) && !state.test(adj_v, SearchState::in_open)) {
 			++num_v_explored;
-			// Calculate adj_v's h_score, push it into open_list, and set its prev_vertex
+			// Calculate adj_v's h_score, push it into open_list, and set its parent
 			// to src_v
-			adj_v->h_score = calculateH(adj_v);
-			open_list.push(adj_v);
-			adj_v->in_open = true;
-			adj_v->prev_vertex = src_v->loc;
+			open_list.push({ calculateH(adj_v), adj_v });
+			state.set(adj_v, SearchState::in_open);
+			state.parent[adj_v] = src_v;
 		}
 	}
 
 
-	// Returns true if a given vertex is either walkable, start, or goal
-	bool isWalkable(Vertex* v) {
-		return v->type == Cell::walkable || v->type == Cell::start || v->type == Cell::goal;
-	}
-
-
 	// Prints out data describing path
 	void printData() const {
 		std::cout << "Greedy best-first search path\n";
@@ -188,18 +186,19 @@ private:
 	// Backtrack from goal to find the shortest path between start and goal; sets the type of
 	// each vertex in the path equal to "path"
 	void reconstructPath() {
-		Vertex* v_goal = &(vertices[goal.row][goal.col]);
-		Coordinate v_path = v_goal->prev_vertex;
+		map = grid.toMap();
+		uint32_t v_start = grid.index(start);
+		uint32_t v_path = state.parent[grid.index(goal)];
 		++total_path_length;
-		while (!(v_path == start)) {
-			if (v_path == Coordinate{ -1, -1 }) {
+		while (v_path != v_start) {
+			if (v_path == SearchState::no_parent) {
 				std::cout << "No path found\n";
 				total_path_length = 0;
 				break;
 			}
-			map[v_path.row][v_path.col] = Cell::path;
-			Vertex* v = &(vertices[v_path.row][v_path.col]);
-			v_path = v->prev_vertex;
+			Coordinate loc = grid.coord(v_path);
+			map[loc.row][loc.col] = Cell::path;
+			v_path = state.parent[v_path];
 			++total_path_length;
 		}
 	} // reconstructPath()
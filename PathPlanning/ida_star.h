@@ -0,0 +1,297 @@
+#pragma once
+
+#include <vector>
+#include <climits>
+#include <algorithm>
+#include "structs.h"
+
+
+// Implementation of IDA* (iterative deepening A*); runs depth-first searches bounded by an
+// f_score threshold that is raised after every failed iteration, so it needs no open list. A
+// fixed-size transposition table remembers the lowest g_score each vertex was reached with in
+// the current iteration, which prunes the duplicate paths that would otherwise make IDA*
+// exponential on a grid. The table is sized to fit the memory limit, or capped at a fixed
+// default size without one, so memory use does not grow with the map
+class IDAStar {
+private:
+
+	// Vertex on the current depth-first path
+	struct Frame {
+
+		// Index of the vertex in grid
+		uint32_t v;
+
+		// Cost to get from start to v along the current path
+		int g_score;
+
+		// Number of adjacent vertices already tried, in the order above, below, left, right
+		int next_adj;
+
+	}; // struct Frame
+
+	// Transposition table entry; lowest g_score v was reached with in the iteration
+	struct TableEntry {
+
+		uint32_t v = SearchState::no_parent;
+
+		int g_score = INT_MAX;
+
+		// Iteration the entry was written in; entries from older iterations are ignored
+		int iteration = -1;
+
+	}; // struct TableEntry
+
+	// Most entries the transposition table gets without a memory limit; 3 MB, enough for an
+	// entry per cell on maps of up to 512 x 512
+	static constexpr size_t default_table_size = 1 << 18;
+
+
+// ---------- Member variables ----------
+
+	// Map shared with the other planners; vertex types are read from here
+	const Grid& grid;
+
+	// Used for printing the path; filled in by reconstructPath()
+	std::vector<std::vector<Cell>> map;
+
+	// Current depth-first path from start; holds the path to goal once it is found
+	std::vector<Frame> path;
+
+	// Transposition table; its size is a power of two
+	std::vector<TableEntry> table;
+
+	// Finds the shortest path between these two vertices
+	Coordinate start;
+
+	Coordinate goal;
+
+	// Maximum number of bytes the search may use for its path and table; 0 means no limit
+	size_t memory_limit;
+
+	// Largest number of bytes used at once by the path and table
+	size_t peak_memory = 0;
+
+	// Set if the search gave up because it would have needed more than memory_limit bytes
+	bool memory_exceeded = false;
+
+	// Set once goal has been reached
+	bool found = false;
+
+	// Set by plan(); search() gives up as soon as it is cancelled
+	const CancelToken* cancel = nullptr;
+
+	// Number of vertices explored
+	int num_v_explored = 0;
+
+	// Length of path
+	int total_path_length = 0;
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor; memory_limit_in is the most bytes the search may use, or 0 for no limit.
+	// The transposition table gets one entry per cell, up to default_table_size entries without
+	// a limit, and up to half of the limit with one, leaving the rest for the depth-first path
+	IDAStar(const Grid& grid_in, const Coordinate& start_in, const Coordinate& goal_in,
+		size_t memory_limit_in = 0)
+		: grid{ grid_in }, start{ start_in }, goal{ goal_in }, memory_limit{ memory_limit_in } {
+		// Checks that start and goal are walkable spaces
+		if (!grid.isWalkable(grid.index(start)) || !grid.isWalkable(grid.index(goal))) {
+			std::cerr << "Invalid start or goal coordinate\n";
+			exit(1);
+		}
+
+		// Smallest power of two with an entry per cell, halved until it fits in the limit or
+		// the default size
+		size_t num_entries = 1;
+		while (num_entries < grid.size()) {
+			num_entries *= 2;
+		}
+		while (num_entries > 1 && (memory_limit == 0 ? num_entries > default_table_size
+			: num_entries * sizeof(TableEntry) > memory_limit / 2)) {
+			num_entries /= 2;
+		}
+		table.resize(num_entries);
+	} // IDAStar()
+
+	// Uses IDA* to find the shortest path between start and goal
+	std::vector<std::vector<Cell>> findPath() {
+		search();
+		// Mark the path between start and goal
+		reconstructPath();
+		// Print data describing path
+		printData();
+
+		return map;
+	} // findPath()
+
+	// Same as findPath(), but prints nothing and returns the cells of the path instead of
+	// a map; the search gives up early if cancel_in is set
+	PathResult plan(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search()) {
+			return { {}, num_v_explored, true };
+		}
+		PathResult result{ {}, num_v_explored };
+		if (found) {
+			for (const Frame& frame : path) {
+				result.path.push_back(grid.coord(frame.v));
+			}
+		}
+		return result;
+	} // plan()
+
+	// Largest number of bytes used at once by the path and table
+	size_t peakMemory() const {
+		return peak_memory;
+	} // peakMemory()
+
+	// True if the search gave up because it would have exceeded its memory limit
+	bool memoryExceeded() const {
+		return memory_exceeded;
+	} // memoryExceeded()
+
+private:
+
+	// Runs bounded depth-first iterations until goal is reached, no vertex was cut off by the
+	// bound, or the memory limit is hit; returns false if it was cancelled first
+	bool search() {
+		uint32_t v_start = grid.index(start);
+		int bound = calculateH(v_start);
+		updateMemory();
+		for (int iteration = 0; !found && bound != INT_MAX && !memory_exceeded; ++iteration) {
+			// Smallest f_score that was over bound in this iteration
+			int next_bound = INT_MAX;
+			path.clear();
+			path.push_back({ v_start, 0, 0 });
+			probe(v_start, 0, iteration);
+
+			while (!path.empty()) {
+				// Stop early if the search has been cancelled
+				if (isCancelled(cancel)) {
+					return false;
+				}
+				Frame& frame = path.back();
+				if (frame.v == grid.index(goal)) {
+					found = true;
+					break;
+				}
+				// Backtrack once every adjacent vertex has been tried
+				if (frame.next_adj == 4) {
+					path.pop_back();
+					continue;
+				}
+				uint32_t adj_v;
+				if (!adjacent(frame.v, frame.next_adj++, adj_v) || !grid.isWalkable(adj_v)) {
+					continue;
+				}
+				int new_g_score = frame.g_score + 1;
+				int f_score = new_g_score + calculateH(adj_v);
+				// Cut off vertices over the bound; the smallest of them is the next bound
+				if (f_score > bound) {
+					next_bound = std::min(next_bound, f_score);
+					continue;
+				}
+				// Prune adj_v if it was already reached as cheaply in this iteration; this also
+				// stops the search from walking in circles
+				if (!probe(adj_v, new_g_score, iteration)) {
+					continue;
+				}
+				++num_v_explored;
+				path.push_back({ adj_v, new_g_score, 0 });
+				if (!updateMemory()) {
+					break;
+				}
+			}
+			bound = next_bound;
+		}
+		return true;
+	} // search()
+
+	// Looks v up in the transposition table; returns false if v was already reached with a
+	// g_score no higher than g_score in this iteration, otherwise records g_score and returns true
+	bool probe(uint32_t v, int g_score, int iteration) {
+		TableEntry& entry = table[hashIndex(v)];
+		if (entry.iteration == iteration && entry.v == v && entry.g_score <= g_score) {
+			return false;
+		}
+		entry = { v, g_score, iteration };
+		return true;
+	} // probe()
+
+	// Position of v in table
+	size_t hashIndex(uint32_t v) const {
+		// Multiplying by an odd constant maps distinct cells to distinct slots as long as the
+		// table has an entry per cell, and spreads neighboring cells apart when it does not
+		return size_t(v * 2654435761u) & (table.size() - 1);
+	} // hashIndex()
+
+	// Sets adj_v to the adjacent vertex of v in direction dir (0 above, 1 below, 2 left,
+	// 3 right); returns false if that would be out of bounds
+	bool adjacent(uint32_t v, int dir, uint32_t& adj_v) const {
+		Coordinate loc = grid.coord(v);
+		switch (dir) {
+		case 0:
+			adj_v = grid.above(v);
+			return loc.row != 0;
+		case 1:
+			adj_v = grid.below(v);
+			return loc.row != grid.numRows() - 1;
+		case 2:
+			adj_v = grid.left(v);
+			return loc.col != 0;
+		default:
+			adj_v = grid.right(v);
+			return loc.col != grid.numCols() - 1;
+		}
+	} // adjacent()
+
+	// Estimates the cost to get from v to goal
+	int calculateH(uint32_t v) {
+		Coordinate loc = grid.coord(v);
+		int x_dist = abs(goal.col - loc.col);
+		int y_dist = abs(goal.row - loc.row);
+		return x_dist + y_dist;
+	} // calculateH()
+
+	// Records the bytes in use by the path and table; returns false and sets memory_exceeded
+	// if they are over memory_limit
+	bool updateMemory() {
+		size_t bytes = path.capacity() * sizeof(Frame) + table.capacity() * sizeof(TableEntry);
+		peak_memory = std::max(peak_memory, bytes);
+		if (memory_limit != 0 && bytes > memory_limit) {
+			memory_exceeded = true;
+			return false;
+		}
+		return true;
+	} // updateMemory()
+
+	// Sets the type of each vertex on the path found between start and goal equal to "path"
+	void reconstructPath() {
+		map = grid.toMap();
+		if (!found) {
+			std::cout << "No path found\n";
+			return;
+		}
+		total_path_length = int(path.size()) - 1;
+		// Leave start and goal marked as they are
+		for (size_t i = 1; i + 1 < path.size(); ++i) {
+			Coordinate loc = grid.coord(path[i].v);
+			map[loc.row][loc.col] = Cell::path;
+		}
+	} // reconstructPath()
+
+	// Prints out data describing path
+	void printData() const {
+		std::cout << "IDA* path \n";
+		if (memory_exceeded) {
+			std::cout << "Memory limit exceeded\n";
+		}
+		std::cout << "Cells examined: " << num_v_explored << "\n";
+		std::cout << "Path length: " << total_path_length << "\n";
+		std::cout << "Peak memory: " << peak_memory << " bytes\n\n";
+	} // printData()
+
+
+}; // class IDAStar
@@ -1,9 +1,26 @@
 #include <iostream>
 #include <vector>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <thread>
 #include "dijkstra.h"
 #include "a_star.h"
 #include "bfs_dfs.h"
 #include "greedy_best_fs.h"
+#include "fringe_search.h"
+#include "ida_star.h"
+#include "subgoal_graph.h"
+#include "path_database.h"
+#include "quadtree.h"
+#include "sipp.h"
+#include "cbs.h"
+#include "theta_star.h"
+#include "map_store.h"
+#include "trace.h"
+#include "server.h"
+#include "perf_counters.h"
 
 
 using Map = std::vector<std::vector<Cell>>;
@@ -24,11 +41,82 @@ std::pair<Coordinate, Coordinate> readStartGoal();
 // Check that start and goal coordinates are both walkable
 void checkStartGoal(const Map& map, const Coordinate& start, const Coordinate& goal);
 
+// Runs A* and Dijkstra between start and goal on a copy of the map in each cell layout and
+// prints the time, cells examined, and cache and TLB misses of each search
+void benchmarkLayouts(const Map& map, const Coordinate& start, const Coordinate& goal);
+
+// Checks that CBS plans a single agent along a shortest path between random cells reachable
+// from start, then places growing fleets of agents at random cells reachable from start, plans
+// for each fleet with CBS and ECBS, and prints the search statistics of each run
+void benchmarkAgents(const Map& map, const Coordinate& start);
+
+// Runs A* between start and goal on several threads for a few seconds, each query on the
+// latest snapshot of a MapStore, while another thread applies batches of random cell changes;
+// prints query and update latencies
+void benchmarkUpdates(const Map& map, const Coordinate& start, const Coordinate& goal);
+
+// Runs BFS, Dijkstra, and A* on a batch of queries (start to goal and random pairs of cells
+// reachable from start) and prints the time and hardware counters of each query phase,
+// summed over the batch
+void benchmarkPhases(const Map& map, const Coordinate& start, const Coordinate& goal);
+
+// Runs Fringe Search and IDA* between start and goal with no memory limit, then with limits
+// of all, half, a quarter, and so on of the memory they used, and prints the time, cells examined,
+// path length, and peak memory of each run, or that it gave up
+void benchmarkMemory(const Map& map, const Coordinate& start, const Coordinate& goal);
+
+// Constructs a Planner between start and goal inside the setup phase of the calling thread's
+// profile, then returns plan(planner)
+template <typename Planner, typename Plan>
+PathResult profileQuery(const Grid& grid, const Coordinate& start, const Coordinate& goal, Plan plan);
+
+
+// With no arguments, reads a map and a start and goal coordinate and runs every planner on them;
+// "--memory-limit <bytes>" does the same, but gives Fringe Search and IDA* at most that much
+// memory.
+// With "--server [socket_path]", reads only the map and then answers QUERY/SET/STATS requests
+// (see server.h) from the rest of cin, or from a Unix domain socket if socket_path is given.
+// With "--benchmark-layouts", reads a map and a start and goal coordinate and compares the
+// cell layouts of Grid on large A* and Dijkstra searches. With "--benchmark-agents", reads a
+// map and a start and goal coordinate and runs multi-agent planning for fleets of increasing
+// size around start. With "--benchmark-updates", reads a map and a start and goal coordinate
+// and measures queries running while the map is being changed. With "--benchmark-phases",
+// reads a map and a start and goal coordinate and profiles the phases of batched queries. With
+// "--benchmark-memory", reads a map and a start and goal coordinate and runs the
+// memory-bounded planners under shrinking limits. With "--render-trace <trace> <ppm> [search]",
+// renders a search from a trace file written by a build with
+// PATHPLANNING_TRACE defined as a heatmap of its expansion order (see trace.h)
+int main(int argc, char* argv[]) {
+	// Unsynced streams buffer cin themselves, which lets the server see how much input is already
+	// waiting; this must happen before the first read
+	std::ios::sync_with_stdio(false);
+	if (argc > 3 && std::string(argv[1]) == "--render-trace") {
+		int search = argc > 4 ? std::atoi(argv[4]) : -1;
+		if (!SearchTrace::renderHeatmap(argv[2], argv[3], search)) {
+			std::cerr << "Could not render search " << search << " of " << argv[2] << " to " << argv[3] << "\n";
+			return 1;
+		}
+		return 0;
+	}
 
-int main() {
 	// Reads map data from cin or input file
 	Map map = readMap();
 
+	if (argc > 1 && std::string(argv[1]) == "--server") {
+		Grid grid(map);
+		QueryServer server(grid);
+		if (argc > 2) {
+#ifndef _WIN32
+			server.serveSocket(argv[2]);
+#else
+			std::cerr << "Unix domain sockets are not supported on this platform\n";
+#endif
+			return 1;
+		}
+		server.serveStream(std::cin, std::cout);
+		return 0;
+	}
+
 	// Reads start and goal coordinates from cin or input file
 	std::pair<Coordinate, Coordinate> path_ends = readStartGoal();
 
@@ -37,6 +125,32 @@ int main() {
 	Coordinate goal = path_ends.second;
 	// Check that start and goal are both walkable
 	checkStartGoal(map, start, goal);
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-layouts") {
+		benchmarkLayouts(map, start, goal);
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-agents") {
+		benchmarkAgents(map, start);
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-phases") {
+		benchmarkPhases(map, start, goal);
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-updates") {
+		benchmarkUpdates(map, start, goal);
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-memory") {
+		benchmarkMemory(map, start, goal);
+		return 0;
+	}
+
+	// Most bytes Fringe Search and IDA* may use; 0 means no limit
+	size_t memory_limit = 0;
+	if (argc > 2 && std::string(argv[1]) == "--memory-limit") {
+		memory_limit = std::strtoull(argv[2], nullptr, 10);
+	}
 	map[start.row][start.col] = Cell::start;
 	map[goal.row][goal.col] = Cell::goal;
 
@@ -44,23 +158,60 @@ int main() {
 	std::cout << "\nOriginal map:\n\n";
 	printMap(map);
 
+	// Flat copy of the map shared by every planner
+	Grid grid(map);
+
 	// Runs path planning algorithms and prints the paths they find, the length of the path, 
 	// and how many cells were examined in the process (a simple measure of efficiency)
 
-	BreadthDepthSearch bfs_path(map, start, goal);
+	BreadthDepthSearch bfs_path(grid, start, goal);
 	printMap(bfs_path.findPathBFS());
 
-	BreadthDepthSearch dfs_path(map, start, goal);
+	BreadthDepthSearch dfs_path(grid, start, goal);
 	printMap(dfs_path.findPathDFS());
 
-	Dijkstra d_path(map, start, goal);
+	Dijkstra d_path(grid, start, goal);
 	printMap(d_path.findPath());
 
-	GreedyBestFS gbfs_path(map, start, goal);
+	GreedyBestFS gbfs_path(grid, start, goal);
 	printMap(gbfs_path.findPath());
 	
-	AStar a_path(map, start, goal);
+	AStar a_path(grid, start, goal);
 	printMap(a_path.findPath());
+	// The search has finished, so this only extracts its path; Lazy Theta* compares against it
+	PathResult grid_path = a_path.plan();
+
+	FringeSearch fringe_path(grid, start, goal, memory_limit);
+	printMap(fringe_path.findPath());
+
+	IDAStar ida_path(grid, start, goal, memory_limit);
+	printMap(ida_path.findPath());
+
+	SubgoalGraph subgoal_graph(grid);
+	printMap(subgoal_graph.findPath(start, goal));
+
+	// Another agent walks from goal to start along a shortest path at the same time; SIPP
+	// plans around it
+	ReservationTable reservations(grid);
+	reservations.reservePath(BreadthDepthSearch(grid, goal, start).planBFS().path);
+	reservations.build();
+	SIPP sipp_path(grid, reservations, start, goal);
+	printMap(sipp_path.findPath());
+
+	QuadtreeMap quadtree(grid);
+	printMap(quadtree.findPath(start, goal));
+
+	PathDatabase path_database(grid, { goal });
+	printMap(path_database.findPath(start, goal));
+
+	WalkableMask walkable_mask(grid);
+	LazyThetaStar theta_path(grid, walkable_mask, start, goal);
+	printMap(theta_path.findPath(grid_path));
+
+	// Builds with tracing write the events of every search above that ran on this thread
+	if (SearchTrace::enabled && SearchTrace::dump("search.trace", grid)) {
+		std::cout << "Search trace written to search.trace\n";
+	}
 
 	return 0;
 } // main()
@@ -114,4 +265,313 @@ void checkStartGoal(const Map& map, const Coordinate& start, const Coordinate& g
 		std::cerr << "Invalid start or goal coordinate\n";
 		exit(1);
 	}
-}
\ No newline at end of file
+}
+
+// Runs A* and Dijkstra between start and goal on a copy of the map in each cell layout and
+// prints the time, cells examined, and cache and TLB misses of each search
+void benchmarkLayouts(const Map& map, const Coordinate& start, const Coordinate& goal) {
+	struct LayoutOption {
+		const char* name;
+		Layout layout;
+		int tile_size;
+	};
+	const LayoutOption layouts[] = {
+		{ "row-major", Layout::row_major, 0 },
+		{ "tiled 8x8", Layout::tiled, 8 },
+		{ "tiled 64x64", Layout::tiled, 64 },
+		{ "morton", Layout::morton, 0 }
+	};
+
+	PerfCounters counters;
+	if (!counters.has(PerfCounters::cache_misses)) {
+		std::cout << "Hardware cache counters are not available; only times are reported\n";
+	}
+	std::cout << std::left << std::setw(14) << "layout" << std::setw(10) << "planner" << std::setw(10) << "ms"
+		<< std::setw(12) << "examined" << std::setw(14) << "cache misses" << std::setw(11) << "miss rate"
+		<< "dTLB misses\n";
+	for (const LayoutOption& option : layouts) {
+		Grid grid(map, option.layout, option.tile_size);
+		for (const char* planner : { "astar", "dijkstra" }) {
+			auto t_start = std::chrono::steady_clock::now();
+			counters.start();
+			PathResult result = std::string(planner) == "astar" ? AStar(grid, start, goal).plan()
+				: Dijkstra(grid, start, goal).plan();
+			counters.stop();
+			auto t_end = std::chrono::steady_clock::now();
+
+			std::ostringstream misses, rate, tlb;
+			if (counters.has(PerfCounters::cache_misses)) {
+				misses << counters.value(PerfCounters::cache_misses);
+			}
+			if (counters.has(PerfCounters::cache_misses) && counters.has(PerfCounters::cache_references)
+				&& counters.value(PerfCounters::cache_references) != 0) {
+				rate << std::fixed << std::setprecision(1) << 100.0 * counters.value(PerfCounters::cache_misses)
+					/ counters.value(PerfCounters::cache_references) << "%";
+			}
+			if (counters.has(PerfCounters::dtlb_misses)) {
+				tlb << counters.value(PerfCounters::dtlb_misses);
+			}
+			std::cout << std::setw(14) << option.name << std::setw(10) << planner << std::setw(10)
+				<< std::chrono::duration_cast<std::chrono::milliseconds>(t_end - t_start).count()
+				<< std::setw(12) << result.num_v_explored
+				<< std::setw(14) << (misses.str().empty() ? "n/a" : misses.str())
+				<< std::setw(11) << (rate.str().empty() ? "n/a" : rate.str())
+				<< (tlb.str().empty() ? "n/a" : tlb.str()) << "\n";
+		}
+	}
+} // benchmarkLayouts()
+
+void benchmarkAgents(const Map& map, const Coordinate& start) {
+	Grid grid(map);
+	// Agents start and end at cells reachable from start, so every agent alone has a path
+	Dijkstra dijkstra(grid, start, start);
+	const std::vector<int>& distances = dijkstra.distances();
+	std::vector<Coordinate> reachable;
+	for (uint32_t v = 0; v < grid.size(); ++v) {
+		if (distances[v] != INT_MAX) {
+			reachable.push_back(grid.coord(v));
+		}
+	}
+
+	std::mt19937 rng(1);
+	// A single agent has no conflicts, so CBS must find a path exactly as short as BFS
+	const int num_checks = 200;
+	int num_mismatches = 0;
+	std::uniform_int_distribution<size_t> pick(0, reachable.size() - 1);
+	for (int i = 0; i < num_checks; ++i) {
+		Coordinate from = reachable[pick(rng)], to = reachable[pick(rng)];
+		MultiPathResult cbs_result = CBS(grid, { from }, { to }, 1.0, 1).solve();
+		PathResult bfs_result = BreadthDepthSearch(grid, from, to).planBFS();
+		if (cbs_result.paths.size() != 1 || cbs_result.paths[0].size() != bfs_result.path.size()) {
+			++num_mismatches;
+		}
+	}
+	std::cout << "Single-agent CBS matched BFS path length on " << num_checks - num_mismatches << " of "
+		<< num_checks << " queries\n\n";
+
+	// Constraint tree nodes to try before giving up on a fleet
+	const long long max_nodes = 5000;
+	std::cout << std::left << std::setw(8) << "agents" << std::setw(8) << "weight" << std::setw(10) << "ms"
+		<< std::setw(10) << "cost" << std::setw(12) << "hl nodes" << std::setw(12) << "ll searches"
+		<< std::setw(14) << "ll expanded" << std::setw(10) << "hl ms" << "ll ms\n";
+	for (size_t num_agents : { 10, 25, 50, 100, 200 }) {
+		if (2 * num_agents > reachable.size()) {
+			break;
+		}
+		// Distinct starts, and distinct goals, drawn from the reachable cells
+		std::shuffle(reachable.begin(), reachable.end(), rng);
+		std::vector<Coordinate> starts(reachable.begin(), reachable.begin() + num_agents);
+		std::shuffle(reachable.begin(), reachable.end(), rng);
+		std::vector<Coordinate> goals(reachable.begin(), reachable.begin() + num_agents);
+
+		for (double weight : { 1.0, 1.5 }) {
+			CBS cbs(grid, starts, goals, weight, 0, max_nodes);
+			MultiPathResult result = cbs.solve();
+			const CBS::Stats& stats = cbs.lastStats();
+			long long cost = 0;
+			for (const std::vector<Coordinate>& path : result.paths) {
+				cost += path.size() - 1;
+			}
+			std::cout << std::setw(8) << num_agents << std::setw(8) << weight << std::setw(10)
+				<< int(stats.total_seconds * 1000) << std::setw(10) << (result.paths.empty() ? "none" : std::to_string(cost))
+				<< std::setw(12) << stats.high_level_generated << std::setw(12) << stats.low_level_searches
+				<< std::setw(14) << stats.low_level_expanded << std::setw(10) << int(stats.high_level_seconds * 1000)
+				<< int(stats.low_level_seconds * 1000) << "\n";
+		}
+	}
+} // benchmarkAgents()
+
+void benchmarkUpdates(const Map& map, const Coordinate& start, const Coordinate& goal) {
+	MapStore store(map);
+	const auto duration = std::chrono::seconds(3);
+	// Cells changed per batch, and the pause between batches
+	const int batch_size = 100;
+	const auto batch_interval = std::chrono::milliseconds(10);
+
+	// Longest and total query time of each reader, and its number of queries
+	unsigned num_readers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	std::vector<double> longest(num_readers, 0), total(num_readers, 0);
+	std::vector<int> num_queries(num_readers, 0);
+	std::atomic<bool> done{ false };
+	auto t_begin = std::chrono::steady_clock::now();
+	auto reader = [&](unsigned id) {
+		while (!done) {
+			auto t_start = std::chrono::steady_clock::now();
+			MapStore::Reader snapshot = store.snapshot();
+			AStar(snapshot->grid, start, goal).plan();
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+			longest[id] = std::max(longest[id], ms);
+			total[id] += ms;
+			++num_queries[id];
+		}
+	};
+	std::vector<std::thread> readers;
+	for (unsigned id = 0; id < num_readers; ++id) {
+		readers.emplace_back(reader, id);
+	}
+
+	// Flip random cells other than start and goal between walkable and obstacle
+	std::mt19937 rng(1);
+	int num_batches = 0;
+	double longest_update = 0, total_update = 0;
+	std::vector<CellDelta> deltas;
+	while (std::chrono::steady_clock::now() - t_begin < duration) {
+		deltas.clear();
+		while (int(deltas.size()) < batch_size) {
+			Coordinate loc{ int(rng() % map.size()), int(rng() % map[0].size()) };
+			if (!(loc == start) && !(loc == goal)) {
+				deltas.push_back({ loc.row, loc.col, rng() % 2 ? Cell::walkable : Cell::obstacle });
+			}
+		}
+		auto t_start = std::chrono::steady_clock::now();
+		store.apply(deltas);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+		longest_update = std::max(longest_update, ms);
+		total_update += ms;
+		++num_batches;
+		std::this_thread::sleep_for(batch_interval);
+	}
+	done = true;
+	for (std::thread& t : readers) {
+		t.join();
+	}
+
+	int queries = 0;
+	double query_ms = 0, longest_query = 0;
+	for (unsigned id = 0; id < num_readers; ++id) {
+		queries += num_queries[id];
+		query_ms += total[id];
+		longest_query = std::max(longest_query, longest[id]);
+	}
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "Readers: " << num_readers << "\n";
+	std::cout << "Queries: " << queries << ", mean " << (queries ? query_ms / queries : 0) << " ms, longest "
+		<< longest_query << " ms\n";
+	std::cout << "Batches of " << batch_size << " changes: " << num_batches << ", mean "
+		<< (num_batches ? total_update / num_batches : 0) << " ms, longest " << longest_update << " ms\n";
+	std::cout << "Chunks copied per batch: " << (num_batches ? double(store.numChunksCopied()) / num_batches : 0)
+		<< " of " << store.snapshot()->grid.numChunks() << "\n";
+	std::cout << "Final version: " << store.version() << "\n";
+} // benchmarkUpdates()
+
+void benchmarkPhases(const Map& map, const Coordinate& start, const Coordinate& goal) {
+	Grid grid(map);
+	// The batch is start to goal and random pairs of cells reachable from start
+	const int batch_size = 32;
+	Dijkstra dijkstra(grid, start, start);
+	const std::vector<int>& distances = dijkstra.distances();
+	std::vector<Coordinate> reachable;
+	for (uint32_t v = 0; v < grid.size(); ++v) {
+		if (distances[v] != INT_MAX) {
+			reachable.push_back(grid.coord(v));
+		}
+	}
+	std::vector<std::pair<Coordinate, Coordinate>> queries = { { start, goal } };
+	std::mt19937 rng(1);
+	while (int(queries.size()) < batch_size) {
+		queries.push_back({ reachable[rng() % reachable.size()], reachable[rng() % reachable.size()] });
+	}
+
+	PerfCounters counters;
+	if (!counters.has(PerfCounters::instructions)) {
+		std::cout << "Hardware counters are not available; only times are reported\n";
+	}
+	const PerfPhase phases[] = { PerfPhase::setup, PerfPhase::search, PerfPhase::reconstruct };
+	const char* phase_names[] = { "setup", "search", "reconstruct" };
+	std::cout << "Batches of " << batch_size << " queries; counts are per cell examined\n";
+	std::cout << std::left << std::setw(10) << "planner" << std::setw(13) << "phase" << std::setw(10) << "ms"
+		<< std::setw(14) << "instructions" << std::setw(8) << "IPC" << std::setw(15) << "branch misses"
+		<< std::setw(14) << "cache misses" << "dTLB misses\n";
+	for (const std::string planner : { "bfs", "dijkstra", "astar" }) {
+		PerfProfile profile;
+		long long examined = 0;
+		for (const std::pair<Coordinate, Coordinate>& query : queries) {
+			PathResult result;
+			if (planner == "bfs") {
+				result = profileQuery<BreadthDepthSearch>(grid, query.first, query.second,
+					[](BreadthDepthSearch& p) { return p.planBFS(); });
+			}
+			else if (planner == "dijkstra") {
+				result = profileQuery<Dijkstra>(grid, query.first, query.second, [](Dijkstra& p) { return p.plan(); });
+			}
+			else {
+				result = profileQuery<AStar>(grid, query.first, query.second, [](AStar& p) { return p.plan(); });
+			}
+			examined += result.num_v_explored;
+		}
+
+		// Counts that are not available are shown as n/a
+		auto perCell = [&](PerfPhase phase, PerfCounters::Event event) {
+			std::ostringstream text;
+			if (profile.has(event)) {
+				text << std::fixed << std::setprecision(2) << double(profile.total(phase, event)) / std::max(1LL, examined);
+			}
+			return text.str().empty() ? std::string("n/a") : text.str();
+		};
+		for (int p = 0; p < 3; ++p) {
+			PerfPhase phase = phases[p];
+			std::ostringstream ms, ipc;
+			ms << std::fixed << std::setprecision(2) << profile.seconds(phase) * 1000;
+			if (profile.has(PerfCounters::instructions) && profile.has(PerfCounters::cycles)
+				&& profile.total(phase, PerfCounters::cycles) != 0) {
+				ipc << std::fixed << std::setprecision(2) << double(profile.total(phase, PerfCounters::instructions))
+					/ profile.total(phase, PerfCounters::cycles);
+			}
+			std::cout << std::setw(10) << (p == 0 ? planner : "") << std::setw(13) << phase_names[p] << std::setw(10)
+				<< ms.str() << std::setw(14) << perCell(phase, PerfCounters::instructions) << std::setw(8)
+				<< (ipc.str().empty() ? "n/a" : ipc.str()) << std::setw(15) << perCell(phase, PerfCounters::branch_misses)
+				<< std::setw(14) << perCell(phase, PerfCounters::cache_misses) << perCell(phase, PerfCounters::dtlb_misses)
+				<< "\n";
+		}
+	}
+} // benchmarkPhases()
+
+template <typename Planner, typename Plan>
+PathResult profileQuery(const Grid& grid, const Coordinate& start, const Coordinate& goal, Plan plan) {
+	std::unique_ptr<Planner> planner;
+	{
+		PerfScope scope(PerfPhase::setup);
+		planner.reset(new Planner(grid, start, goal));
+	}
+	return plan(*planner);
+} // profileQuery()
+
+
+void benchmarkMemory(const Map& map, const Coordinate& start, const Coordinate& goal) {
+	Grid grid(map);
+	std::cout << std::left << std::setw(10) << "planner" << std::setw(14) << "limit" << std::setw(10) << "ms"
+		<< std::setw(12) << "examined" << std::setw(10) << "length" << "peak bytes\n";
+	for (const char* planner : { "fringe", "idastar" }) {
+		size_t limit = 0;
+		while (true) {
+			auto t_start = std::chrono::steady_clock::now();
+			PathResult result;
+			size_t peak_memory;
+			bool exceeded;
+			if (std::string(planner) == "fringe") {
+				FringeSearch fringe(grid, start, goal, limit);
+				result = fringe.plan();
+				peak_memory = fringe.peakMemory();
+				exceeded = fringe.memoryExceeded();
+			}
+			else {
+				IDAStar ida(grid, start, goal, limit);
+				result = ida.plan();
+				peak_memory = ida.peakMemory();
+				exceeded = ida.memoryExceeded();
+			}
+			auto t_end = std::chrono::steady_clock::now();
+
+			std::cout << std::setw(10) << planner << std::setw(14) << (limit == 0 ? "none" : std::to_string(limit))
+				<< std::setw(10) << std::chrono::duration_cast<std::chrono::milliseconds>(t_end - t_start).count()
+				<< std::setw(12) << result.num_v_explored
+				<< std::setw(10) << (result.path.empty() ? "-" : std::to_string(result.path.size() - 1))
+				<< (exceeded ? "gave up" : std::to_string(peak_memory)) << "\n";
+			// Start from what the unlimited run used and halve the limit until the planner gives up
+			if (exceeded || peak_memory < 2) {
+				break;
+			}
+			limit = limit == 0 ? peak_memory : limit / 2;
+		}
+	}
+} // benchmarkMemory()
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include "structs.h"
+
+
+// New type of one cell, part of a batch of map updates
+struct CellDelta {
+
+	int row;
+
+	int col;
+
+	Cell type;
+
+}; // struct CellDelta
+
+// Immutable version of the map; planners are given snapshot->grid and can run for as long as
+// they hold the snapshot, however many updates are applied in the meantime
+struct MapSnapshot {
+
+	// Number of batches applied before this snapshot; the first snapshot is version 0
+	uint64_t version;
+
+	Grid grid;
+
+}; // struct MapSnapshot
+
+// Versioned store of a map that changes while queries are running. Writers apply batches of
+// cell deltas; each batch produces a new snapshot that shares every chunk of cells it did not
+// touch with the previous one (see Grid), so an update copies only the chunks it changes.
+// Readers never lock: the latest snapshot is an atomic pointer, and a reader protects the one
+// it loads by publishing it in a hazard slot of its own and checking that it is still the
+// latest. A writer publishes its snapshot only after applying the whole batch to it, then frees
+// each replaced snapshot once no hazard slot holds it, so neither side ever waits for the other.
+// A snapshot, and any chunk no other snapshot uses, is freed by the first apply() after the
+// last reader holding it lets go
+class MapStore {
+private:
+
+	// Hazard slot of one reader; slots are linked into a list that only grows, and a slot is
+	// reused by the next reader once the one holding it lets go
+	struct HazardSlot {
+
+		// Snapshot the reader holding this slot is using, or null
+		std::atomic<const MapSnapshot*> snapshot{ nullptr };
+
+		// Set while a reader holds this slot
+		std::atomic<bool> in_use{ true };
+
+		HazardSlot* next = nullptr;
+
+	}; // struct HazardSlot
+
+
+// ---------- Member variables ----------
+
+	// Latest snapshot; owned by the store
+	std::atomic<const MapSnapshot*> current;
+
+	// Head of the list of hazard slots; snapshot() adds slots, so it is mutable
+	mutable std::atomic<HazardSlot*> slots{ nullptr };
+
+	// Snapshots replaced by apply() that a reader may still be using; only touched by writers
+	std::vector<const MapSnapshot*> retired;
+
+	// Serializes writers, so each batch is applied on top of the one before it
+	std::mutex write_mutex;
+
+	// Chunks copied by apply() since the store was created
+	std::atomic<uint64_t> chunks_copied{ 0 };
+
+public:
+
+	// A snapshot held by a reader; it stays valid and unchanged until the Reader is destroyed,
+	// which must happen before the store is
+	class Reader {
+	private:
+
+		HazardSlot* slot = nullptr;
+
+		const MapSnapshot* held = nullptr;
+
+		friend class MapStore;
+
+		Reader(HazardSlot* slot_in, const MapSnapshot* held_in) : slot{ slot_in }, held{ held_in } {}
+
+	public:
+
+		Reader(Reader&& other) noexcept : slot{ other.slot }, held{ other.held } {
+			other.slot = nullptr;
+			other.held = nullptr;
+		}
+
+		Reader(const Reader&) = delete;
+
+		Reader& operator=(const Reader&) = delete;
+
+		Reader& operator=(Reader&&) = delete;
+
+		// Lets go of the snapshot and frees the slot for the next reader
+		~Reader() {
+			if (slot) {
+				slot->snapshot.store(nullptr);
+				slot->in_use.store(false, std::memory_order_release);
+			}
+		}
+
+		const MapSnapshot& operator*() const {
+			return *held;
+		}
+
+		const MapSnapshot* operator->() const {
+			return held;
+		}
+
+	}; // class Reader
+
+
+// ---------- Member functions ----------
+
+	// Constructor; version 0 is a chunked grid of map_in in the given layout
+	MapStore(const std::vector<std::vector<Cell>>& map_in, Layout layout = Layout::row_major, int tile_size = 8)
+		: current{ new MapSnapshot{ 0, Grid(map_in, layout, tile_size, true) } } {}
+
+	MapStore(const MapStore&) = delete;
+
+	MapStore& operator=(const MapStore&) = delete;
+
+	// Destructor; every Reader must have been destroyed already
+	~MapStore() {
+		delete current.load();
+		for (const MapSnapshot* snapshot : retired) {
+			delete snapshot;
+		}
+		for (HazardSlot* slot = slots.load(); slot; ) {
+			HazardSlot* next = slot->next;
+			delete slot;
+			slot = next;
+		}
+	} // ~MapStore()
+
+	// Returns the latest snapshot; it stays valid and unchanged for as long as the Reader is
+	// held. Takes no lock, and only retries if a batch is published while it runs
+	Reader snapshot() const {
+		HazardSlot* slot = acquireSlot();
+		const MapSnapshot* latest = current.load();
+		while (true) {
+			slot->snapshot.store(latest);
+			// A writer frees a snapshot only if no slot held it after it was replaced, so once
+			// it is still the latest after the slot is set, it stays alive
+			const MapSnapshot* check = current.load();
+			if (check == latest) {
+				return Reader(slot, latest);
+			}
+			latest = check;
+		}
+	} // snapshot()
+
+	// Applies every delta in one new snapshot and publishes it; returns its version. Deltas
+	// outside the map are ignored, and later deltas to the same cell win
+	uint64_t apply(const std::vector<CellDelta>& deltas) {
+		std::lock_guard<std::mutex> lock(write_mutex);
+		const MapSnapshot* previous = current.load();
+		// Copying the grid shares all of its chunks until setType() writes to one
+		MapSnapshot* next = new MapSnapshot{ previous->version + 1, previous->grid };
+		for (const CellDelta& delta : deltas) {
+			Coordinate loc{ delta.row, delta.col };
+			if (next->grid.inBounds(loc)) {
+				next->grid.setType(next->grid.index(loc), delta.type);
+			}
+		}
+		chunks_copied += next->grid.numChunks() - next->grid.numSharedChunks(previous->grid);
+		uint64_t version = next->version;
+		current.store(next);
+		retired.push_back(previous);
+		reclaim();
+		return version;
+	} // apply()
+
+	// Version of the latest snapshot
+	uint64_t version() const {
+		return snapshot()->version;
+	} // version()
+
+	// Number of chunks of cells copied by every apply() so far
+	uint64_t numChunksCopied() const {
+		return chunks_copied;
+	} // numChunksCopied()
+
+private:
+
+	// Claims a free hazard slot, adding a new one to the list if every slot is in use
+	HazardSlot* acquireSlot() const {
+		HazardSlot* head = slots.load(std::memory_order_acquire);
+		for (HazardSlot* slot = head; slot; slot = slot->next) {
+			bool free = false;
+			if (!slot->in_use.load(std::memory_order_relaxed)
+				&& slot->in_use.compare_exchange_strong(free, true, std::memory_order_acquire)) {
+				return slot;
+			}
+		}
+		HazardSlot* slot = new HazardSlot;
+		slot->next = head;
+		while (!slots.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_acquire)) {
+		}
+		return slot;
+	} // acquireSlot()
+
+	// Frees every retired snapshot that no hazard slot holds; called with write_mutex held
+	void reclaim() {
+		std::vector<const MapSnapshot*> held;
+		for (HazardSlot* slot = slots.load(std::memory_order_acquire); slot; slot = slot->next) {
+			if (const MapSnapshot* snapshot = slot->snapshot.load()) {
+				held.push_back(snapshot);
+			}
+		}
+		size_t kept = 0;
+		for (const MapSnapshot* snapshot : retired) {
+			if (std::find(held.begin(), held.end(), snapshot) != held.end()) {
+				retired[kept++] = snapshot;
+			}
+			else {
+				delete snapshot;
+			}
+		}
+		retired.resize(kept);
+	} // reclaim()
+
+}; // class MapStore
@@ -0,0 +1,404 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <climits>
+#include <unordered_map>
+#include "structs.h"
+#include "dijkstra.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+// Compressed path database (CPD) for a fixed set of key cells. For every key cell it stores
+// the first move of a shortest path from every cell of the map toward that key cell, so a
+// query toward a key cell is answered by repeated table lookups with no search at all. Moves
+// are symmetric on the grid, so the table for key cell k comes from the distances of one
+// Dijkstra run from k. Each table lists the cells in Z-order (Morton order), which keeps
+// nearby cells together, and is compressed into runs of equal moves; obstacles and
+// unreachable cells can take any move, so they never start a run. The whole database is
+// one array of 32-bit words that is written to disk as is and can be memory-mapped back
+class PathDatabase {
+private:
+
+	// Moves stored in the tables
+	enum Move : uint32_t {
+		up, down, left, right
+	};
+
+	// Layout of the words at the start of the database
+	enum Header : uint32_t {
+		magic_word, rows_word, cols_word, num_keys_word, num_runs_word, checksum_lo_word,
+		checksum_hi_word, header_size
+	};
+
+	// First word of a database ("CPD1")
+	static constexpr uint32_t file_magic = 0x31445043;
+
+	// Morton codes are stored in the top 30 bits of a run, so rows and cols must be below this
+	static constexpr int max_side = 1 << 15;
+
+
+// ---------- Member variables ----------
+
+	// Map the database was built for; must not change while the database is in use
+	const Grid& grid;
+
+	// Database words when they were built or read into memory: the header, the cell index of
+	// every key cell, the first run of every key cell's table (plus one past the last run), and
+	// the runs themselves, each a Morton code shifted left by 2 with the move in the low bits
+	std::vector<uint32_t> owned;
+
+	// Start of the database words, in owned or in a memory-mapped file
+	const uint32_t* data = nullptr;
+
+	// Number of words at data
+	size_t data_size = 0;
+
+	// Memory-mapped file backing data, if any
+	void* mapping = nullptr;
+
+	size_t mapping_size = 0;
+
+	// Table number of each key cell, by cell index
+	std::unordered_map<uint32_t, uint32_t> key_table;
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor; builds the database for key_cells, running one Dijkstra search per key cell
+	// spread over num_threads threads (0 uses one per hardware thread)
+	PathDatabase(const Grid& grid_in, const std::vector<Coordinate>& key_cells, unsigned num_threads = 0)
+		: grid{ grid_in } {
+		build(key_cells, num_threads);
+	} // PathDatabase()
+
+	// Constructor; leaves the database empty until load() succeeds
+	PathDatabase(const Grid& grid_in)
+		: grid{ grid_in } {}
+
+	PathDatabase(const PathDatabase&) = delete;
+
+	PathDatabase& operator=(const PathDatabase&) = delete;
+
+	~PathDatabase() {
+		unmap();
+	} // ~PathDatabase()
+
+	// Finds the shortest path between start and goal by table lookups, printing the same data
+	// as the other planners; goal (or start) must be a key cell
+	std::vector<std::vector<Cell>> findPath(const Coordinate& start, const Coordinate& goal) const {
+		PathResult result = plan(start, goal);
+		std::vector<std::vector<Cell>> map = grid.toMap();
+		if (result.path.empty()) {
+			std::cout << "No path found\n";
+		}
+		// Leave start and goal marked as they are
+		for (size_t i = 1; i + 1 < result.path.size(); ++i) {
+			map[result.path[i].row][result.path[i].col] = Cell::path;
+		}
+
+		std::cout << "Compressed path database path \n";
+		std::cout << "Key cells: " << numKeys() << ", runs: " << numRuns() << "\n";
+		std::cout << "Table lookups: " << result.num_v_explored << "\n";
+		std::cout << "Path length: " << (result.path.empty() ? 0 : result.path.size() - 1) << "\n\n";
+		return map;
+	} // findPath()
+
+	// Finds the shortest path between start and goal without printing anything; goal must be a
+	// key cell, or else start, in which case the path is found backwards. num_v_explored in the
+	// result counts table lookups. Safe to call from several threads at once
+	PathResult plan(const Coordinate& start, const Coordinate& goal) const {
+		if (!grid.inBounds(start) || !grid.inBounds(goal)) {
+			return {};
+		}
+		uint32_t v_start = grid.index(start);
+		uint32_t v_goal = grid.index(goal);
+		auto it = key_table.find(v_goal);
+		bool reversed = false;
+		if (it == key_table.end()) {
+			it = key_table.find(v_start);
+			if (it == key_table.end()) {
+				return {};
+			}
+			std::swap(v_start, v_goal);
+			reversed = true;
+		}
+
+		PathResult result;
+		const uint32_t* runs = data + runsOffset();
+		const uint32_t* run_begin = runs + data[keysOffset() + numKeys() + it->second];
+		const uint32_t* run_end = runs + data[keysOffset() + numKeys() + it->second + 1];
+		uint32_t v = v_start;
+		result.path.push_back(grid.coord(v));
+		// A shortest path never visits a cell twice, so more steps than cells means v cannot
+		// reach goal and the moves looked up for it are meaningless
+		while (v != v_goal && result.path.size() <= grid.size()) {
+			Coordinate loc = grid.coord(v);
+			uint32_t key = morton(loc) << 2 | 3;
+			const uint32_t* run = std::upper_bound(run_begin, run_end, key) - 1;
+			++result.num_v_explored;
+			if (!step(v, Move(*run & 3), v) || !grid.isWalkable(v)) {
+				return { {}, result.num_v_explored };
+			}
+			result.path.push_back(grid.coord(v));
+		}
+		if (v != v_goal) {
+			return { {}, result.num_v_explored };
+		}
+		if (reversed) {
+			std::reverse(result.path.begin(), result.path.end());
+		}
+		return result;
+	} // plan()
+
+	// Number of key cells in the database
+	uint32_t numKeys() const {
+		return data ? data[num_keys_word] : 0;
+	} // numKeys()
+
+	// Total number of runs over every key cell's table
+	uint32_t numRuns() const {
+		return data ? data[num_runs_word] : 0;
+	} // numRuns()
+
+	// Writes the database to a binary file; returns false if the file could not be written
+	bool save(const std::string& path) const {
+		std::ofstream out(path, std::ios::binary);
+		out.write((const char*)data, data_size * sizeof(uint32_t));
+		return data && bool(out);
+	} // save()
+
+	// Reads a database written by save(), memory-mapping the file where the platform allows;
+	// returns false and leaves the database unchanged if the file cannot be read or was built
+	// for a different map
+	bool load(const std::string& path) {
+#ifndef _WIN32
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st;
+		void* new_mapping = MAP_FAILED;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			new_mapping = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		close(fd);
+		if (new_mapping == MAP_FAILED) {
+			return false;
+		}
+		size_t num_words = size_t(st.st_size) / sizeof(uint32_t);
+		if (!isValid((const uint32_t*)new_mapping, num_words)) {
+			munmap(new_mapping, size_t(st.st_size));
+			return false;
+		}
+		unmap();
+		owned.clear();
+		mapping = new_mapping;
+		mapping_size = size_t(st.st_size);
+		setData((const uint32_t*)mapping, num_words);
+		return true;
+#else
+		std::ifstream in(path, std::ios::binary | std::ios::ate);
+		std::vector<uint32_t> words(size_t(in.tellg()) / sizeof(uint32_t));
+		in.seekg(0);
+		in.read((char*)words.data(), words.size() * sizeof(uint32_t));
+		if (!in || !isValid(words.data(), words.size())) {
+			return false;
+		}
+		owned = std::move(words);
+		setData(owned.data(), owned.size());
+		return true;
+#endif
+	} // load()
+
+private:
+
+	// Position of the key cells, row starts, and runs in the database words
+	static constexpr size_t keysOffset() {
+		return header_size;
+	} // keysOffset()
+
+	size_t runsOffset() const {
+		return header_size + 2 * size_t(numKeys()) + 1;
+	} // runsOffset()
+
+	// Runs one Dijkstra search per key cell on a pool of threads and compresses each search
+	// tree into a table
+	void build(const std::vector<Coordinate>& key_cells, unsigned num_threads) {
+		if (grid.numRows() > max_side || grid.numCols() > max_side) {
+			std::cerr << "Map is too large for a compressed path database\n";
+			return;
+		}
+		for (const Coordinate& key : key_cells) {
+			if (!grid.inBounds(key) || !grid.isWalkable(grid.index(key))) {
+				std::cerr << "Invalid key cell\n";
+				return;
+			}
+		}
+
+		// Every walkable cell in Z-order
+		std::vector<uint32_t> order;
+		for (uint32_t v = 0; v < grid.size(); ++v) {
+			if (grid.isWalkable(v)) {
+				order.push_back(v);
+			}
+		}
+		std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+			return morton(grid.coord(a)) < morton(grid.coord(b));
+		});
+
+		// Each thread takes the next key cell until there are none left
+		std::vector<std::vector<uint32_t>> tables(key_cells.size());
+		std::atomic<size_t> next_key{ 0 };
+		auto worker = [&]() {
+			for (size_t k = next_key++; k < key_cells.size(); k = next_key++) {
+				Dijkstra dijkstra(grid, key_cells[k], key_cells[k]);
+				tables[k] = compress(dijkstra.distances(), order);
+			}
+		};
+		if (num_threads == 0) {
+			num_threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < num_threads; ++i) {
+			threads.emplace_back(worker);
+		}
+		for (std::thread& t : threads) {
+			t.join();
+		}
+
+		uint64_t checksum = grid.checksum();
+		std::vector<uint32_t> words = { file_magic, uint32_t(grid.numRows()), uint32_t(grid.numCols()),
+			uint32_t(key_cells.size()), 0, uint32_t(checksum), uint32_t(checksum >> 32) };
+		for (const Coordinate& key : key_cells) {
+			words.push_back(grid.index(key));
+		}
+		uint32_t num_runs = 0;
+		for (const std::vector<uint32_t>& table : tables) {
+			words.push_back(num_runs);
+			num_runs += uint32_t(table.size());
+		}
+		words.push_back(num_runs);
+		words[num_runs_word] = num_runs;
+		for (const std::vector<uint32_t>& table : tables) {
+			words.insert(words.end(), table.begin(), table.end());
+		}
+
+		unmap();
+		owned = std::move(words);
+		setData(owned.data(), owned.size());
+	} // build()
+
+	// Turns the distances from one Dijkstra search into runs of equal first moves over the
+	// cells in order. Any move to a neighbor one step closer to the key cell is a first move of
+	// a shortest path, so the move of the current run is kept whenever it is one of them; cells
+	// with no first move (the key cell itself and unreachable cells) extend whatever run they
+	// fall in
+	std::vector<uint32_t> compress(const std::vector<int>& dist, const std::vector<uint32_t>& order) const {
+		std::vector<uint32_t> runs;
+		for (uint32_t v : order) {
+			if (dist[v] == 0 || dist[v] == INT_MAX) {
+				continue;
+			}
+			if (!runs.empty() && isFirstMove(v, Move(runs.back() & 3), dist)) {
+				continue;
+			}
+			uint32_t move = up;
+			while (!isFirstMove(v, Move(move), dist)) {
+				++move;
+			}
+			// The first run covers every position before it as well
+			runs.push_back(runs.empty() ? move : morton(grid.coord(v)) << 2 | move);
+		}
+		if (runs.empty()) {
+			runs.push_back(up);
+		}
+		return runs;
+	} // compress()
+
+	// Returns true if move takes v one step closer to the key cell whose distances are dist
+	bool isFirstMove(uint32_t v, Move move, const std::vector<int>& dist) const {
+		uint32_t adj_v;
+		return step(v, move, adj_v) && grid.isWalkable(adj_v) && dist[adj_v] == dist[v] - 1;
+	} // isFirstMove()
+
+	// Sets adj_v to the neighbor of v in direction move; returns false if that would be out
+	// of bounds
+	bool step(uint32_t v, Move move, uint32_t& adj_v) const {
+		Coordinate loc = grid.coord(v);
+		switch (move) {
+		case up:
+			adj_v = grid.above(v);
+			return loc.row != 0;
+		case down:
+			adj_v = grid.below(v);
+			return loc.row != grid.numRows() - 1;
+		case left:
+			adj_v = grid.left(v);
+			return loc.col != 0;
+		default:
+			adj_v = grid.right(v);
+			return loc.col != grid.numCols() - 1;
+		}
+	} // step()
+
+	// Z-order position of a cell: the bits of its row and column interleaved
+	static uint32_t morton(const Coordinate& loc) {
+		return interleaveBits(uint32_t(loc.row), uint32_t(loc.col));
+	} // morton()
+
+	// Returns true if the num_words words at words hold a database built for grid
+	bool isValid(const uint32_t* words, size_t num_words) const {
+		if (num_words < header_size || words[magic_word] != file_magic
+			|| words[rows_word] != uint32_t(grid.numRows()) || words[cols_word] != uint32_t(grid.numCols())) {
+			return false;
+		}
+		uint64_t checksum = uint64_t(words[checksum_hi_word]) << 32 | words[checksum_lo_word];
+		size_t num_keys = words[num_keys_word];
+		size_t expected = header_size + 2 * num_keys + 1 + size_t(words[num_runs_word]);
+		if (checksum != grid.checksum() || num_keys > grid.size() || num_words != expected) {
+			return false;
+		}
+		for (size_t k = 0; k < num_keys; ++k) {
+			size_t begin = words[header_size + num_keys + k];
+			size_t end = words[header_size + num_keys + k + 1];
+			if (words[header_size + k] >= grid.size() || begin >= end || end > words[num_runs_word]) {
+				return false;
+			}
+		}
+		return true;
+	} // isValid()
+
+	// Points data at the database words and indexes the key cells
+	void setData(const uint32_t* words, size_t num_words) {
+		data = words;
+		data_size = num_words;
+		key_table.clear();
+		for (uint32_t k = 0; k < numKeys(); ++k) {
+			key_table.emplace(data[keysOffset() + k], k);
+		}
+	} // setData()
+
+	// Releases the memory-mapped file, if any
+	void unmap() {
+#ifndef _WIN32
+		if (mapping) {
+			munmap(mapping, mapping_size);
+		}
+#endif
+		mapping = nullptr;
+		mapping_size = 0;
+	} // unmap()
+
+}; // class PathDatabase
@@ -0,0 +1,354 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+
+// Hardware counters for the calling thread, read through perf_event_open on Linux. Counters
+// that cannot be opened (other platforms, containers without a PMU, or a restrictive
+// perf_event_paranoid setting) are simply reported as unavailable, so callers can always use
+// this class and print "n/a" for the missing values.
+// The counters are opened as one group, so the PMU schedules them together and ratios such as
+// instructions per cycle compare counts from the same time window; the group is read with a
+// single read(). A counter the PMU cannot fit in the group is counted on its own instead. If
+// the kernel multiplexes a counter with other users of the PMU, its count is scaled up by the
+// time it was enabled over the time it actually ran
+class PerfCounters {
+public:
+
+	// Events that are counted
+	enum Event {
+		// Accesses to the last level cache, and the ones that missed it
+		cache_references,
+		cache_misses,
+		// Data loads that missed the TLB
+		dtlb_misses,
+		// Instructions retired and CPU cycles
+		instructions,
+		cycles,
+		// Branches that were mispredicted
+		branch_misses,
+		num_events
+	};
+
+private:
+
+// ---------- Member variables ----------
+
+	// File descriptor of each event's counter, or -1 if it could not be opened
+	int fds[num_events];
+
+	// Descriptor of the group leader, the first counter opened; -1 if none could be opened
+	int leader = -1;
+
+	// Events in the leader's group, in the order they joined it, which is the order a group
+	// read returns their counts in
+	Event group[num_events];
+
+	int group_size = 0;
+
+	// Count of each event between the last start() and stop(), scaled for multiplexing
+	uint64_t values[num_events] = {};
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor; opens every counter that the platform allows, disabled, in one group where
+	// possible
+	PerfCounters() {
+		for (int e = 0; e < num_events; ++e) {
+			fds[e] = openCounter(Event(e), leader);
+			if (fds[e] >= 0) {
+				if (leader < 0) {
+					leader = fds[e];
+				}
+				group[group_size++] = Event(e);
+			}
+			else if (leader >= 0) {
+				fds[e] = openCounter(Event(e), -1);
+			}
+		}
+	} // PerfCounters()
+
+	PerfCounters(const PerfCounters&) = delete;
+
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	~PerfCounters() {
+#ifdef __linux__
+		for (int fd : fds) {
+			if (fd >= 0) {
+				close(fd);
+			}
+		}
+#endif
+	} // ~PerfCounters()
+
+	// True if event is being counted
+	bool has(Event event) const {
+		return fds[event] >= 0;
+	} // has()
+
+	// Resets and starts every counter
+	void start() {
+#ifdef __linux__
+		if (leader >= 0) {
+			ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+		for (int e = 0; e < num_events; ++e) {
+			if (fds[e] >= 0 && !inGroup(Event(e))) {
+				ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+				ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+#endif
+	} // start()
+
+	// Stops every counter and records its count
+	void stop() {
+#ifdef __linux__
+		memset(values, 0, sizeof(values));
+		if (leader >= 0) {
+			ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+			// Number of counters, time enabled, time running, and one count per counter
+			uint64_t data[3 + num_events];
+			ssize_t expected = ssize_t((3 + group_size) * sizeof(uint64_t));
+			if (read(leader, data, sizeof(data)) == expected && data[0] == uint64_t(group_size)) {
+				for (int i = 0; i < group_size; ++i) {
+					values[group[i]] = scale(data[3 + i], data[1], data[2]);
+				}
+			}
+		}
+		for (int e = 0; e < num_events; ++e) {
+			if (fds[e] >= 0 && !inGroup(Event(e))) {
+				ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+				uint64_t data[4];
+				if (read(fds[e], data, sizeof(data)) == ssize_t(sizeof(data)) && data[0] == 1) {
+					values[e] = scale(data[3], data[1], data[2]);
+				}
+			}
+		}
+#endif
+	} // stop()
+
+	// Count of event between the last start() and stop(); 0 if it is not available
+	uint64_t value(Event event) const {
+		return values[event];
+	} // value()
+
+private:
+
+	// True if event is counted in the leader's group
+	bool inGroup(Event event) const {
+		for (int i = 0; i < group_size; ++i) {
+			if (group[i] == event) {
+				return true;
+			}
+		}
+		return false;
+	} // inGroup()
+
+	// Estimate of the full count of a counter that was only running for part of the time it
+	// was enabled; 0 if it never ran
+	static uint64_t scale(uint64_t count, uint64_t time_enabled, uint64_t time_running) {
+		if (time_running == 0) {
+			return 0;
+		}
+		if (time_running >= time_enabled) {
+			return count;
+		}
+		return uint64_t(double(count) * double(time_enabled) / double(time_running));
+	} // scale()
+
+	// Opens a counter for event on the calling thread, as a member of the group led by
+	// group_fd, or as a disabled group leader or counter of its own if group_fd is -1; returns
+	// -1 if it cannot
+	static int openCounter(Event event, int group_fd) {
+#ifdef __linux__
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		// Members follow their leader, which is enabled and disabled for the whole group
+		attr.disabled = group_fd < 0;
+		// A counter of its own reads as a group of one
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.type = PERF_TYPE_HARDWARE;
+		switch (event) {
+		case cache_references:
+			attr.config = PERF_COUNT_HW_CACHE_REFERENCES;
+			break;
+		case cache_misses:
+			attr.config = PERF_COUNT_HW_CACHE_MISSES;
+			break;
+		case dtlb_misses:
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+				| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			break;
+		case instructions:
+			attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+			break;
+		case cycles:
+			attr.config = PERF_COUNT_HW_CPU_CYCLES;
+			break;
+		default:
+			attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+			break;
+		}
+		return int(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+#else
+		(void)event;
+		(void)group_fd;
+		return -1;
+#endif
+	} // openCounter()
+
+}; // class PerfCounters
+
+// Phases of a query that are profiled separately: constructing the planner, its search loop,
+// and turning the search tree into a path
+enum class PerfPhase {
+	setup,
+	search,
+	reconstruct,
+	num_phases
+};
+
+// Hardware counter totals and wall time of each phase, summed over every query run on a
+// thread while the profile is installed there. Planners mark their phases with PerfScope,
+// which does nothing on threads without a profile, so queries only pay for the counters
+// while someone is measuring them
+class PerfProfile {
+private:
+
+	static constexpr int num_phases = int(PerfPhase::num_phases);
+
+// ---------- Member variables ----------
+
+	PerfCounters counters;
+
+	// Totals of each event, seconds, and number of scopes of each phase
+	uint64_t totals[num_phases][PerfCounters::num_events] = {};
+
+	double phase_seconds[num_phases] = {};
+
+	uint64_t phase_count[num_phases] = {};
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor; installs the profile on the calling thread, replacing any other
+	PerfProfile() {
+		current() = this;
+	} // PerfProfile()
+
+	PerfProfile(const PerfProfile&) = delete;
+
+	PerfProfile& operator=(const PerfProfile&) = delete;
+
+	// Uninstalls the profile from the calling thread, which must be the one that created it
+	~PerfProfile() {
+		if (current() == this) {
+			current() = nullptr;
+		}
+	} // ~PerfProfile()
+
+	// Profile installed on the calling thread, or null
+	static PerfProfile*& current() {
+		thread_local PerfProfile* profile = nullptr;
+		return profile;
+	} // current()
+
+	// True if event is being counted
+	bool has(PerfCounters::Event event) const {
+		return counters.has(event);
+	} // has()
+
+	// Total count of event during phase; 0 if it is not available
+	uint64_t total(PerfPhase phase, PerfCounters::Event event) const {
+		return totals[int(phase)][event];
+	} // total()
+
+	// Total wall time of phase, in seconds
+	double seconds(PerfPhase phase) const {
+		return phase_seconds[int(phase)];
+	} // seconds()
+
+	// Number of times phase was measured
+	uint64_t count(PerfPhase phase) const {
+		return phase_count[int(phase)];
+	} // count()
+
+	// Clears every total
+	void reset() {
+		memset(totals, 0, sizeof(totals));
+		memset(phase_seconds, 0, sizeof(phase_seconds));
+		memset(phase_count, 0, sizeof(phase_count));
+	} // reset()
+
+private:
+
+	friend class PerfScope;
+
+	void start() {
+		counters.start();
+	} // start()
+
+	// Stops the counters and adds their counts and seconds to phase
+	void stop(PerfPhase phase, double seconds_in) {
+		counters.stop();
+		for (int e = 0; e < PerfCounters::num_events; ++e) {
+			totals[int(phase)][e] += counters.value(PerfCounters::Event(e));
+		}
+		phase_seconds[int(phase)] += seconds_in;
+		++phase_count[int(phase)];
+	} // stop()
+
+}; // class PerfProfile
+
+// Counts one phase of a query, from construction to destruction, in the calling thread's
+// profile; does nothing if the thread has none. Scopes must not be nested
+class PerfScope {
+private:
+
+	PerfProfile* profile;
+
+	PerfPhase phase;
+
+	std::chrono::steady_clock::time_point t_start;
+
+public:
+
+	explicit PerfScope(PerfPhase phase_in)
+		: profile{ PerfProfile::current() }, phase{ phase_in } {
+		if (profile) {
+			t_start = std::chrono::steady_clock::now();
+			profile->start();
+		}
+	} // PerfScope()
+
+	PerfScope(const PerfScope&) = delete;
+
+	PerfScope& operator=(const PerfScope&) = delete;
+
+	~PerfScope() {
+		if (profile) {
+			auto t_end = std::chrono::steady_clock::now();
+			profile->stop(phase, std::chrono::duration<double>(t_end - t_start).count());
+		}
+	} // ~PerfScope()
+
+}; // class PerfScope
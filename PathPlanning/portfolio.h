@@ -0,0 +1,138 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include "structs.h"
+#include "a_star.h"
+#include "bfs_dfs.h"
+#include "dijkstra.h"
+#include "greedy_best_fs.h"
+#include "fringe_search.h"
+#include "ida_star.h"
+
+
+// Runs several planners at once on separate threads over the same read-only grid; the first
+// planner to produce an acceptable answer wins and cancels the others
+class PlannerPortfolio {
+public:
+
+	enum class Mode {
+		// Accept the first answer from any planner
+		first_found,
+		// Accept the first answer from a planner that always finds a shortest path
+		first_optimal
+	};
+
+	// Answer returned by run()
+	struct Result {
+
+		// Name of the planner that produced the answer, as accepted by run()
+		std::string algorithm;
+
+		// Path found by that planner; empty if there is no path
+		PathResult result;
+
+	}; // struct Result
+
+private:
+
+// ---------- Member variables ----------
+
+	// Map shared by every planner thread; must not change while run() is in progress
+	const Grid& grid;
+
+	Coordinate start;
+
+	Coordinate goal;
+
+	// Set by the winning thread to stop every other planner
+	CancelToken cancel{ false };
+
+	// Guards winner and has_winner
+	std::mutex winner_mutex;
+
+	Result winner;
+
+	bool has_winner = false;
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor
+	PlannerPortfolio(const Grid& grid_in, const Coordinate& start_in, const Coordinate& goal_in)
+		: grid{ grid_in }, start{ start_in }, goal{ goal_in } {}
+
+	// Races the given planners ("bfs", "dfs", "dijkstra", "greedy", "astar", "fringe",
+	// "idastar") and returns the winner's answer. In first_optimal mode only the planners that
+	// always find a shortest path may win with a path;
+	// a "no path" answer is final in either mode since every planner is complete. If no planner
+	// qualifies, the returned algorithm is empty
+	Result run(Mode mode, const std::vector<std::string>& algorithms
+		= { "bfs", "dfs", "dijkstra", "greedy", "astar" }) {
+		cancel.store(false);
+		has_winner = false;
+		winner = {};
+
+		std::vector<std::thread> threads;
+		for (const std::string& algorithm : algorithms) {
+			threads.emplace_back([this, mode, algorithm]() {
+				PathResult result = runPlanner(algorithm);
+				if (result.cancelled) {
+					return;
+				}
+				if (mode == Mode::first_optimal && !result.path.empty() && !isOptimal(algorithm)) {
+					return;
+				}
+				std::lock_guard<std::mutex> lock(winner_mutex);
+				if (!has_winner) {
+					has_winner = true;
+					winner = { algorithm, std::move(result) };
+					cancel.store(true, std::memory_order_relaxed);
+				}
+			});
+		}
+		for (std::thread& t : threads) {
+			t.join();
+		}
+		return winner;
+	} // run()
+
+	// Returns true if algorithm always finds a shortest path on a 4-connected grid
+	static bool isOptimal(const std::string& algorithm) {
+		return algorithm == "bfs" || algorithm == "dijkstra" || algorithm == "astar"
+			|| algorithm == "fringe" || algorithm == "idastar";
+	} // isOptimal()
+
+private:
+
+	// Runs one planner, checking cancel once per iteration of its search loop
+	PathResult runPlanner(const std::string& algorithm) {
+		if (algorithm == "astar") {
+			return AStar(grid, start, goal).plan(&cancel);
+		}
+		if (algorithm == "dijkstra") {
+			return Dijkstra(grid, start, goal).plan(&cancel);
+		}
+		if (algorithm == "bfs") {
+			return BreadthDepthSearch(grid, start, goal).planBFS(&cancel);
+		}
+		if (algorithm == "dfs") {
+			return BreadthDepthSearch(grid, start, goal).planDFS(&cancel);
+		}
+		if (algorithm == "greedy") {
+			return GreedyBestFS(grid, start, goal).plan(&cancel);
+		}
+		if (algorithm == "fringe") {
+			return FringeSearch(grid, start, goal).plan(&cancel);
+		}
+		if (algorithm == "idastar") {
+			return IDAStar(grid, start, goal).plan(&cancel);
+		}
+		// Unknown planners never win
+		return { {}, 0, true };
+	} // runPlanner()
+
+}; // class PlannerPortfolio
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <climits>
+#include <algorithm>
+#include "structs.h"
+
+
+// Quadtree over a map; squares that are entirely walkable or entirely blocked are kept whole,
+// so a large open area becomes a handful of leaves instead of one vertex per cell. Walkable
+// leaves are the nodes of a graph whose edges are portals, the runs of cells where two leaves
+// touch. A query runs A* over the leaves, entering each leaf at one cell and leaving it
+// through the portal cell that looks cheapest toward goal, then refines the chain of leaves
+// back into grid moves. Any path inside a leaf has Manhattan length, but a leaf is entered at
+// a single cell, so the path found is not always the shortest one
+class QuadtreeMap {
+private:
+
+	// Value of a tree node that is an entirely blocked square
+	static constexpr uint32_t blocked = UINT32_MAX;
+
+	// Set in the value of a tree node that is a walkable leaf; the other bits are the leaf id
+	static constexpr uint32_t leaf_bit = 1u << 31;
+
+	// Walkable square of cells
+	struct Leaf {
+
+		// Top left cell of the square
+		int row;
+
+		int col;
+
+		// Length of each side of the square
+		int size;
+
+	}; // struct Leaf
+
+	// Run of cells along one side of a leaf that all touch the same neighboring leaf
+	struct Portal {
+
+		// Id of the neighboring leaf
+		uint32_t leaf;
+
+		// First cell of the run, inside the leaf the portal belongs to; the run continues to
+		// the right for portals above or below the leaf and downwards for portals to its left or
+		// right
+		int row;
+
+		int col;
+
+		// Number of cells in the run
+		int length;
+
+		// Step that crosses into the neighboring leaf
+		int d_row;
+
+		int d_col;
+
+	}; // struct Portal
+
+	// Entry in the open list of a query
+	struct OpenEntry {
+
+		// Sum of estimated cost to goal and cost from start
+		int f_score;
+
+		// Id of the leaf
+		uint32_t leaf;
+
+	}; // OpenEntry struct
+
+	// Functor to compare two open list entries; returns true if entry a's f is greater
+	// than entry b's f
+	class FComp {
+	public:
+
+		bool operator()(const OpenEntry& a, const OpenEntry& b) {
+			return a.f_score > b.f_score;
+		}
+	}; // class FComp
+
+
+// ---------- Member variables ----------
+
+	// Map the tree was built for; must not change while the tree is in use
+	const Grid& grid;
+
+	// Side of the root square; the smallest power of two that covers the map
+	int root_size = 1;
+
+	// Nodes of the tree; each is blocked, a walkable leaf (leaf_bit | id), or the index of the
+	// first of its four children (top left, top right, bottom left, bottom right). The root is
+	// nodes[0], and cells outside the map count as blocked
+	std::vector<uint32_t> nodes;
+
+	// Every walkable leaf; a leaf's position in this vector is its id
+	std::vector<Leaf> leaves;
+
+	// Portals of every leaf in compressed sparse row form; the portals of leaf i are
+	// portals[portal_begin[i]] to portals[portal_begin[i + 1] - 1]
+	std::vector<uint32_t> portal_begin;
+
+	std::vector<Portal> portals;
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor; builds the tree and the portals between its leaves
+	QuadtreeMap(const Grid& grid_in)
+		: grid{ grid_in } {
+		build();
+	} // QuadtreeMap()
+
+	// Finds a path between start and goal; prints the same data as the other planners, along
+	// with how much memory the tree uses, and returns the map with the path marked
+	std::vector<std::vector<Cell>> findPath(const Coordinate& start, const Coordinate& goal) const {
+		PathResult result = plan(start, goal);
+		std::vector<std::vector<Cell>> map = grid.toMap();
+		if (result.path.empty()) {
+			std::cout << "No path found\n";
+		}
+		// Leave start and goal marked as they are
+		for (size_t i = 1; i + 1 < result.path.size(); ++i) {
+			map[result.path[i].row][result.path[i].col] = Cell::path;
+		}
+
+		// Parent, g_score, and flags of every cell, as kept by the per-cell planners
+		size_t cell_bytes = grid.size() * (sizeof(uint32_t) + sizeof(int) + sizeof(uint8_t));
+		std::cout << "Quadtree path \n";
+		std::cout << "Leaves: " << leaves.size() << ", portals: " << portals.size() / 2 << "\n";
+		std::cout << "Memory: " << memoryBytes() << " bytes (per-cell search state: " << cell_bytes << " bytes)\n";
+		std::cout << "Leaves examined: " << result.num_v_explored << "\n";
+		std::cout << "Path length: " << (result.path.empty() ? 0 : result.path.size() - 1) << "\n\n";
+		return map;
+	} // findPath()
+
+	// Finds a path between start and goal without printing anything; num_v_explored in the
+	// result counts leaves pushed into the open list. Safe to call from several threads at once
+	PathResult plan(const Coordinate& start, const Coordinate& goal) const {
+		if (!grid.inBounds(start) || !grid.inBounds(goal)
+			|| !grid.isWalkable(grid.index(start)) || !grid.isWalkable(grid.index(goal))) {
+			return {};
+		}
+		uint32_t start_leaf = locate(start);
+		uint32_t goal_leaf = locate(goal);
+
+		// Search state is kept per leaf; entry is the cell each leaf was entered at
+		std::vector<int> g_score(leaves.size(), INT_MAX);
+		std::vector<uint32_t> parent(leaves.size(), SearchState::no_parent);
+		std::vector<Coordinate> entry(leaves.size());
+		std::vector<char> closed(leaves.size(), false);
+		std::priority_queue<OpenEntry, std::vector<OpenEntry>, FComp> open_list;
+		int num_v_explored = 0;
+
+		g_score[start_leaf] = 0;
+		entry[start_leaf] = start;
+		open_list.push({ distance(start, goal), start_leaf });
+		while (!open_list.empty()) {
+			uint32_t leaf = open_list.top().leaf;
+			open_list.pop();
+			if (closed[leaf]) {
+				continue;
+			}
+			closed[leaf] = true;
+			if (leaf == goal_leaf) {
+				break;
+			}
+
+			for (uint32_t p = portal_begin[leaf]; p < portal_begin[leaf + 1]; ++p) {
+				const Portal& portal = portals[p];
+				if (closed[portal.leaf]) {
+					continue;
+				}
+				Coordinate exit = bestExit(portal, entry[leaf], goal);
+				Coordinate adj_entry{ exit.row + portal.d_row, exit.col + portal.d_col };
+				int new_g_score = g_score[leaf] + distance(entry[leaf], exit) + 1;
+				if (new_g_score < g_score[portal.leaf]) {
+					++num_v_explored;
+					g_score[portal.leaf] = new_g_score;
+					parent[portal.leaf] = leaf;
+					entry[portal.leaf] = adj_entry;
+					open_list.push({ new_g_score + distance(adj_entry, goal), portal.leaf });
+				}
+			}
+		}
+
+		if (!closed[goal_leaf]) {
+			return { {}, num_v_explored };
+		}
+		// Walk the chain of leaves from start; inside each leaf, go from its entry cell to the
+		// cell next to the following leaf's entry cell, then step across
+		std::vector<uint32_t> chain;
+		for (uint32_t leaf = goal_leaf; leaf != SearchState::no_parent; leaf = parent[leaf]) {
+			chain.push_back(leaf);
+		}
+		std::reverse(chain.begin(), chain.end());
+		PathResult result{ { start }, num_v_explored };
+		for (size_t i = 0; i + 1 < chain.size(); ++i) {
+			const Leaf& leaf = leaves[chain[i]];
+			Coordinate next = entry[chain[i + 1]];
+			Coordinate exit{ std::min(std::max(next.row, leaf.row), leaf.row + leaf.size - 1),
+				std::min(std::max(next.col, leaf.col), leaf.col + leaf.size - 1) };
+			walk(exit, result.path);
+			result.path.push_back(next);
+		}
+		walk(goal, result.path);
+		return result;
+	} // plan()
+
+	// Number of walkable leaves
+	size_t numLeaves() const {
+		return leaves.size();
+	} // numLeaves()
+
+	// Bytes used by the tree, leaves, and portals
+	size_t memoryBytes() const {
+		return nodes.capacity() * sizeof(uint32_t) + leaves.capacity() * sizeof(Leaf)
+			+ portal_begin.capacity() * sizeof(uint32_t) + portals.capacity() * sizeof(Portal);
+	} // memoryBytes()
+
+private:
+
+	// Builds the tree top down, then finds the portals of every leaf
+	void build() {
+		while (root_size < grid.numRows() || root_size < grid.numCols()) {
+			root_size *= 2;
+		}
+
+		// Number of blocked cells above and to the left of every cell, so that the blocked
+		// cells in any square can be counted in constant time
+		int rows = grid.numRows(), cols = grid.numCols();
+		std::vector<uint32_t> blocked_sum(size_t(rows + 1) * (cols + 1), 0);
+		for (int r = 0; r < rows; ++r) {
+			for (int c = 0; c < cols; ++c) {
+				blocked_sum[size_t(r + 1) * (cols + 1) + c + 1] = blocked_sum[size_t(r) * (cols + 1) + c + 1]
+					+ blocked_sum[size_t(r + 1) * (cols + 1) + c] - blocked_sum[size_t(r) * (cols + 1) + c]
+					+ !grid.isWalkable(grid.index({ r, c }));
+			}
+		}
+
+		nodes.assign(1, blocked);
+		leaves.clear();
+		buildNode(0, 0, 0, root_size, blocked_sum);
+
+		portal_begin.assign(1, 0);
+		portals.clear();
+		for (const Leaf& leaf : leaves) {
+			int last = leaf.size - 1;
+			addPortals(leaf.row, leaf.col, 0, 1, -1, 0);
+			addPortals(leaf.row + last, leaf.col, 0, 1, 1, 0);
+			addPortals(leaf.row, leaf.col, 1, 0, 0, -1);
+			addPortals(leaf.row, leaf.col + last, 1, 0, 0, 1);
+			portal_begin.push_back(uint32_t(portals.size()));
+		}
+	} // build()
+
+	// Fills in nodes[node], which covers the square of the given size at row, col
+	void buildNode(uint32_t node, int row, int col, int size, const std::vector<uint32_t>& blocked_sum) {
+		int rows = grid.numRows(), cols = grid.numCols();
+		int row_end = std::min(row + size, rows), col_end = std::min(col + size, cols);
+		// Blocked cells of the square that lie inside the map
+		uint32_t num_blocked = 0;
+		int area = 0;
+		if (row < row_end && col < col_end) {
+			num_blocked = blocked_sum[size_t(row_end) * (cols + 1) + col_end] - blocked_sum[size_t(row) * (cols + 1) + col_end]
+				- blocked_sum[size_t(row_end) * (cols + 1) + col] + blocked_sum[size_t(row) * (cols + 1) + col];
+			area = (row_end - row) * (col_end - col);
+		}
+		if (int(num_blocked) == area) {
+			nodes[node] = blocked;
+			return;
+		}
+		if (num_blocked == 0 && area == size * size) {
+			nodes[node] = leaf_bit | uint32_t(leaves.size());
+			leaves.push_back({ row, col, size });
+			return;
+		}
+
+		uint32_t first_child = uint32_t(nodes.size());
+		nodes[node] = first_child;
+		nodes.resize(nodes.size() + 4, blocked);
+		int half = size / 2;
+		buildNode(first_child, row, col, half, blocked_sum);
+		buildNode(first_child + 1, row, col + half, half, blocked_sum);
+		buildNode(first_child + 2, row + half, col, half, blocked_sum);
+		buildNode(first_child + 3, row + half, col + half, half, blocked_sum);
+	} // buildNode()
+
+	// Adds a portal for every run of cells along one side of a leaf that touches the same
+	// neighboring leaf; the side starts at row, col and runs in direction (step_row, step_col)
+	// for the length of the last leaf added, and (d_row, d_col) crosses out of the leaf
+	void addPortals(int row, int col, int step_row, int step_col, int d_row, int d_col) {
+		int size = leaves[portal_begin.size() - 1].size;
+		for (int i = 0; i < size;) {
+			Coordinate cell{ row + i * step_row, col + i * step_col };
+			Coordinate adj{ cell.row + d_row, cell.col + d_col };
+			if (!grid.inBounds(adj)) {
+				return;
+			}
+			uint32_t node = locateNode(adj);
+			if (node == blocked) {
+				++i;
+				continue;
+			}
+			// The run ends where the neighboring leaf or this side ends
+			const Leaf& adj_leaf = leaves[node & ~leaf_bit];
+			int adj_end = step_row ? adj_leaf.row + adj_leaf.size - cell.row : adj_leaf.col + adj_leaf.size - cell.col;
+			int length = std::min(adj_end, size - i);
+			portals.push_back({ node & ~leaf_bit, cell.row, cell.col, length, d_row, d_col });
+			i += length;
+		}
+	} // addPortals()
+
+	// Returns the value of the tree node that contains cell
+	uint32_t locateNode(const Coordinate& cell) const {
+		uint32_t node = 0;
+		int row = 0, col = 0, size = root_size;
+		while (nodes[node] != blocked && !(nodes[node] & leaf_bit)) {
+			size /= 2;
+			uint32_t child = nodes[node];
+			if (cell.row >= row + size) {
+				row += size;
+				child += 2;
+			}
+			if (cell.col >= col + size) {
+				col += size;
+				child += 1;
+			}
+			node = child;
+		}
+		return nodes[node];
+	} // locateNode()
+
+	// Returns the id of the leaf that contains cell, which must be walkable
+	uint32_t locate(const Coordinate& cell) const {
+		return locateNode(cell) & ~leaf_bit;
+	} // locate()
+
+	// Cell of portal to leave through when the leaf was entered at from; minimizes the cost
+	// from from to the cell plus the Manhattan distance from across the portal to goal. That
+	// sum is piecewise linear along the portal with its bends at from and goal, so the best
+	// cell is the one nearest either of them
+	static Coordinate bestExit(const Portal& portal, const Coordinate& from, const Coordinate& goal) {
+		bool along_col = portal.d_row != 0;
+		int begin = along_col ? portal.col : portal.row;
+		int end = begin + portal.length - 1;
+		Coordinate best{};
+		int best_cost = INT_MAX;
+		for (int target : { along_col ? from.col : from.row, along_col ? goal.col : goal.row }) {
+			int t = std::min(std::max(target, begin), end);
+			Coordinate cell = along_col ? Coordinate{ portal.row, t } : Coordinate{ t, portal.col };
+			Coordinate across{ cell.row + portal.d_row, cell.col + portal.d_col };
+			int cost = distance(from, cell) + distance(across, goal);
+			if (cost < best_cost) {
+				best_cost = cost;
+				best = cell;
+			}
+		}
+		return best;
+	} // bestExit()
+
+	// Appends the cells from the last cell of path to to, moving along the rows first and
+	// then the columns; both cells must be in the same leaf, so every cell between them is
+	// walkable
+	static void walk(const Coordinate& to, std::vector<Coordinate>& path) {
+		Coordinate cell = path.back();
+		while (cell.row != to.row) {
+			cell.row += cell.row < to.row ? 1 : -1;
+			path.push_back(cell);
+		}
+		while (cell.col != to.col) {
+			cell.col += cell.col < to.col ? 1 : -1;
+			path.push_back(cell);
+		}
+	} // walk()
+
+	// Manhattan distance between two cells
+	static int distance(const Coordinate& a, const Coordinate& b) {
+		return abs(a.row - b.row) + abs(a.col - b.col);
+	} // distance()
+
+}; // class QuadtreeMap
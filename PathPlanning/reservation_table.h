@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vector>
+#include <climits>
+#include <algorithm>
+#include <unordered_map>
+#include "structs.h"
+
+
+// Times at which cells of a map are taken by other agents whose routes are known. Time is
+// counted in moves; an agent following a path is at path[t] at time t. Reservations are
+// collected by reserve() and reservePath() and then indexed by build(), which sorts and merges
+// them into one array of intervals in compressed sparse row form, so cells nobody passes
+// through cost a single offset. Moves are kept separately so that planners can also avoid
+// swapping places with another agent along an edge
+class ReservationTable {
+public:
+
+	// Time of a reservation that never ends
+	static constexpr int forever = INT_MAX;
+
+	// Closed interval of time steps
+	struct Interval {
+
+		int begin;
+
+		int end;
+
+	}; // struct Interval
+
+private:
+
+// ---------- Member variables ----------
+
+	// Map the reservations refer to
+	const Grid& grid;
+
+	// Every reservation added since the last clear(), by cell index
+	std::vector<std::pair<uint32_t, Interval>> reservations;
+
+	// Merged reserved intervals of every cell, sorted by time; the intervals of cell v are
+	// intervals[interval_begin[v]] to intervals[interval_begin[v + 1] - 1]
+	std::vector<uint32_t> interval_begin;
+
+	std::vector<Interval> intervals;
+
+	// Times at which a reserved agent leaves one cell for another, keyed by the two cell
+	// indices
+	std::unordered_map<uint64_t, std::vector<int>> moves;
+
+	// Set while the index matches reservations
+	bool built = true;
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor; starts with no reservations
+	ReservationTable(const Grid& grid_in)
+		: grid{ grid_in }, interval_begin(grid_in.size() + 1, 0) {}
+
+	// Reserves cell from time begin to time end, inclusive
+	void reserve(const Coordinate& cell, int begin, int end) {
+		reservations.push_back({ grid.index(cell), { begin, end } });
+		built = false;
+	} // reserve()
+
+	// Reserves every cell of an agent's path; the agent is at path[i] at time start_time + i
+	// and stays at the last cell of the path forever
+	void reservePath(const std::vector<Coordinate>& path, int start_time = 0) {
+		for (size_t i = 0; i < path.size(); ++i) {
+			int t = start_time + int(i);
+			reserve(path[i], t, i + 1 == path.size() ? forever : t);
+			if (i > 0 && !(path[i] == path[i - 1])) {
+				moves[moveKey(grid.index(path[i - 1]), grid.index(path[i]))].push_back(t - 1);
+			}
+		}
+	} // reservePath()
+
+	// Removes every reservation
+	void clear() {
+		reservations.clear();
+		moves.clear();
+		intervals.clear();
+		interval_begin.assign(grid.size() + 1, 0);
+		built = true;
+	} // clear()
+
+	// Sorts and merges the reservations into the per-cell index; must be called after
+	// reserving and before planning
+	void build() {
+		std::sort(reservations.begin(), reservations.end(),
+			[](const std::pair<uint32_t, Interval>& a, const std::pair<uint32_t, Interval>& b) {
+				return a.first != b.first ? a.first < b.first : a.second.begin < b.second.begin;
+			});
+		intervals.clear();
+		interval_begin.assign(grid.size() + 1, 0);
+		uint32_t prev_v = SearchState::no_parent;
+		for (const std::pair<uint32_t, Interval>& reservation : reservations) {
+			const Interval& next = reservation.second;
+			// Overlapping or touching intervals of the same cell are merged
+			if (reservation.first == prev_v && (intervals.back().end == forever || next.begin <= intervals.back().end + 1)) {
+				intervals.back().end = std::max(intervals.back().end, next.end);
+				continue;
+			}
+			intervals.push_back(next);
+			++interval_begin[reservation.first + 1];
+			prev_v = reservation.first;
+		}
+		for (uint32_t v = 0; v < grid.size(); ++v) {
+			interval_begin[v + 1] += interval_begin[v];
+		}
+		built = true;
+	} // build()
+
+	// True if the index matches every reservation made so far
+	bool isBuilt() const {
+		return built;
+	} // isBuilt()
+
+	// Position of the first reserved interval of cell v in the index
+	uint32_t firstInterval(uint32_t v) const {
+		return interval_begin[v];
+	} // firstInterval()
+
+	// Number of reserved intervals of cell v
+	uint32_t numIntervals(uint32_t v) const {
+		return interval_begin[v + 1] - interval_begin[v];
+	} // numIntervals()
+
+	// Reserved interval at position i of the index
+	const Interval& interval(uint32_t i) const {
+		return intervals[i];
+	} // interval()
+
+	// Total number of reserved intervals in the index
+	uint32_t size() const {
+		return uint32_t(intervals.size());
+	} // size()
+
+	// True if a reserved agent leaves cell from for cell to at time depart
+	bool isMoveReserved(uint32_t from, uint32_t to, int depart) const {
+		auto it = moves.find(moveKey(from, to));
+		return it != moves.end() && std::find(it->second.begin(), it->second.end(), depart) != it->second.end();
+	} // isMoveReserved()
+
+private:
+
+	static uint64_t moveKey(uint32_t from, uint32_t to) {
+		return uint64_t(from) << 32 | to;
+	} // moveKey()
+
+}; // class ReservationTable
@@ -0,0 +1,614 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <memory>
+#include <set>
+#include "structs.h"
+#include "a_star.h"
+#include "bfs_dfs.h"
+#include "dijkstra.h"
+#include "greedy_best_fs.h"
+#include "fringe_search.h"
+#include "ida_star.h"
+#include "subgoal_graph.h"
+#include "path_database.h"
+#include "quadtree.h"
+#include "sipp.h"
+#include "theta_star.h"
+#include "cbs.h"
+#include "trace.h"
+#include "portfolio.h"
+
+#ifndef _WIN32
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+
+// Long-running query server; the map is loaded once and then a stream of newline-delimited
+// requests is answered, one response line per request:
+//   QUERY <algorithm> <start_row> <start_col> <goal_row> <goal_col>
+//     -> PATH <length> <cells_examined> <row>,<col> <row>,<col> ...
+//     -> NOPATH <cells_examined>
+// where algorithm is bfs, dfs, dijkstra, greedy, astar, fringe, idastar, subgoal, quadtree,
+// cpd, sipp, theta, or portfolio / portfolio_optimal to race every planner on separate threads (see
+// portfolio.h)
+//   NEAREST <bfs|dijkstra|astar> <start_row> <start_col> <k> <row> <col> [<row> <col> ...]
+//     -> PATHS <count> <cells_examined> | <length> <row>,<col> ... | <length> ...
+// where NEAREST answers with the paths to the k nearest of the listed goals, nearest first,
+// all found in one search
+//   SUBGOALS <SAVE|LOAD> <file>  -> OK
+// where subgoal queries use a subgoal graph (see subgoal_graph.h) that is built on first use
+// or loaded from a file, and is rebuilt after the map changes; quadtree queries likewise use a
+// quadtree of the map (see quadtree.h)
+//   CPD BUILD <row> <col> [<row> <col> ...]  -> OK
+//   CPD <SAVE|LOAD> <file>                   -> OK
+// where cpd queries look paths up in a compressed path database (see path_database.h) for the
+// listed key cells; the goal or start of a cpd query must be a key cell. The database is
+// dropped when the map changes
+//   RESERVE <time> <row> <col> [<row> <col> ...]  -> OK
+//   RESERVE CLEAR                                  -> OK
+// where sipp queries start at time 0 and plan around every reserved path (see sipp.h); a
+// reserved agent is at the i-th listed cell at time + i and stays at the last one. A sipp
+// PATH lists the cell at every time step, so waits repeat a cell. A theta PATH (see
+// theta_star.h) lists only the waypoints of an any-angle path, so its length is the number of
+// straight segments between them
+//   AGENTS <weight> <start_row> <start_col> <goal_row> <goal_col> [...]
+//     -> PATHS <count> <cells_examined> | <length> <row>,<col> ... | <length> ...
+// where AGENTS plans paths for several agents at once that never meet (see cbs.h); weight 1
+// gives the shortest total, and a larger weight allows that much more in exchange for speed.
+// The paths list the cell at every time step, in the order the agents were given. A request
+// that has not been solved after a few seconds is answered with ERR
+//   TRACE <file>   -> OK
+//   TRACE CLEAR    -> OK
+// where TRACE writes the events recorded by the searches run so far to file, and TRACE CLEAR
+// discards them (see trace.h); both are errors unless the server was built with
+// PATHPLANNING_TRACE defined. Portfolio searches run on other threads and are not included
+//   LIMIT <bytes>   -> OK
+// where fringe and idastar queries may use at most bytes of memory for their search, or any
+// amount if bytes is 0 (the default); a query that needs more is answered with ERR
+//   SET <row> <col> <0|1>   -> OK
+//   STATS                   -> STATS queries=<n> found=<n> sets=<n> search_us=<n>
+// Malformed requests are answered with ERR <reason>. Requests are pipelined: every request
+// already received is answered before the responses are written out in one batch.
+class QueryServer {
+private:
+
+// ---------- Member variables ----------
+
+	// Map loaded once at startup; SET requests modify it in place. Requests are handled one at a
+	// time and every planner thread is joined before the next one, so no search is running while
+	// a cell changes, and the map does not need to be a MapStore (see map_store.h)
+	Grid& grid;
+
+	// Number of QUERY requests answered, and how many of them found a path
+	long long num_queries = 0;
+
+	long long num_found = 0;
+
+	// Number of SET requests applied
+	long long num_sets = 0;
+
+	// Total time spent inside the planners, in microseconds
+	long long search_us = 0;
+
+	// Subgoal graph of grid; null until the first subgoal query or SUBGOALS LOAD, and reset
+	// by SET
+	std::unique_ptr<SubgoalGraph> subgoal_graph;
+
+	// Quadtree of grid; null until the first quadtree query, and reset by SET
+	std::unique_ptr<QuadtreeMap> quadtree;
+
+	// Paths of other agents that sipp queries avoid
+	ReservationTable reservations;
+
+	// Walkable cells of grid as bits; null until the first theta query, and updated by SET
+	std::unique_ptr<WalkableMask> walkable_mask;
+
+	// Compressed path database of grid; null until CPD BUILD or CPD LOAD, and reset by SET
+	std::unique_ptr<PathDatabase> path_database;
+
+	// Most bytes a fringe or idastar query may use; 0 means no limit
+	size_t memory_limit = 0;
+
+	// Most seconds an AGENTS request may plan for before it is answered with ERR, so that an
+	// unsolvable fleet cannot hold up the requests behind it
+	double agents_seconds = 5;
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor
+	QueryServer(Grid& grid_in)
+		: grid{ grid_in }, reservations{ grid_in } {}
+
+	// Answers requests read from in until it is exhausted; responses are flushed to out
+	// whenever no more input is immediately available. in_avail() only sees buffered input, so
+	// for std::cin this batches only once std::ios::sync_with_stdio(false) has been called
+	void serveStream(std::istream& in, std::ostream& out) {
+		std::string line, responses;
+		while (std::getline(in, line)) {
+			handleLine(line, responses);
+			if (in.rdbuf()->in_avail() <= 0) {
+				out << responses << std::flush;
+				responses.clear();
+			}
+		}
+		out << responses << std::flush;
+	} // serveStream()
+
+#ifndef _WIN32
+	// Listens on a Unix domain socket at socket_path and answers requests from one client
+	// connection at a time; only returns if the socket cannot be set up
+	void serveSocket(const std::string& socket_path) {
+		int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un addr{};
+		addr.sun_family = AF_UNIX;
+		if (listen_fd < 0 || socket_path.size() >= sizeof(addr.sun_path)) {
+			std::cerr << "Could not create socket " << socket_path << "\n";
+			return;
+		}
+		socket_path.copy(addr.sun_path, socket_path.size());
+		unlink(socket_path.c_str());
+		// A client disconnecting mid-response must not kill the server
+		signal(SIGPIPE, SIG_IGN);
+		if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 16) < 0) {
+			std::cerr << "Could not listen on socket " << socket_path << "\n";
+			close(listen_fd);
+			return;
+		}
+
+		while (true) {
+			int client_fd = accept(listen_fd, nullptr, nullptr);
+			if (client_fd < 0) {
+				continue;
+			}
+			serveConnection(client_fd);
+			close(client_fd);
+		}
+	} // serveSocket()
+#endif
+
+	// Answers a single request line; appends the response line to out
+	void handleLine(const std::string& line, std::string& out) {
+		std::istringstream request(line);
+		std::string command;
+		if (!(request >> command)) {
+			return;
+		}
+
+		if (command == "QUERY") {
+			std::string algorithm;
+			Coordinate start, goal;
+			if (!(request >> algorithm >> start.row >> start.col >> goal.row >> goal.col)) {
+				out += "ERR expected QUERY <algorithm> <r0> <c0> <r1> <c1>\n";
+				return;
+			}
+			handleQuery(algorithm, start, goal, out);
+		}
+		else if (command == "NEAREST") {
+			std::string algorithm;
+			Coordinate start, goal;
+			size_t k;
+			std::vector<Coordinate> goals;
+			if (!(request >> algorithm >> start.row >> start.col >> k)) {
+				out += "ERR expected NEAREST <algorithm> <r0> <c0> <k> <r> <c> ...\n";
+				return;
+			}
+			while (request >> goal.row >> goal.col) {
+				goals.push_back(goal);
+			}
+			handleNearest(algorithm, start, goals, k, out);
+		}
+		else if (command == "SET") {
+			Coordinate loc;
+			int cell_int;
+			if (!(request >> loc.row >> loc.col >> cell_int) || (cell_int != 0 && cell_int != 1)) {
+				out += "ERR expected SET <row> <col> <0|1>\n";
+				return;
+			}
+			if (!grid.inBounds(loc)) {
+				out += "ERR cell out of bounds\n";
+				return;
+			}
+			grid.setType(grid.index(loc), cell_int == 0 ? Cell::walkable : Cell::obstacle);
+			subgoal_graph.reset();
+			quadtree.reset();
+			path_database.reset();
+			if (walkable_mask) {
+				walkable_mask->set(loc, cell_int == 0);
+			}
+			++num_sets;
+			out += "OK\n";
+		}
+		else if (command == "SUBGOALS") {
+			std::string action, file;
+			if (!(request >> action >> file) || (action != "SAVE" && action != "LOAD")) {
+				out += "ERR expected SUBGOALS <SAVE|LOAD> <file>\n";
+				return;
+			}
+			if (action == "SAVE" && !subgoalGraph().save(file)) {
+				out += "ERR could not write " + file + "\n";
+				return;
+			}
+			if (action == "LOAD") {
+				std::unique_ptr<SubgoalGraph> loaded(new SubgoalGraph(grid, false));
+				if (!loaded->load(file)) {
+					out += "ERR could not load a subgoal graph for this map from " + file + "\n";
+					return;
+				}
+				subgoal_graph = std::move(loaded);
+			}
+			out += "OK\n";
+		}
+		else if (command == "RESERVE") {
+			handleReserve(request, out);
+		}
+		else if (command == "CPD") {
+			handleDatabase(request, out);
+		}
+		else if (command == "AGENTS") {
+			handleAgents(request, out);
+		}
+		else if (command == "TRACE") {
+			std::string file;
+			if (!(request >> file)) {
+				out += "ERR expected TRACE <file> or TRACE CLEAR\n";
+			}
+			else if (!SearchTrace::enabled) {
+				out += "ERR tracing is not compiled in; define PATHPLANNING_TRACE\n";
+			}
+			else if (file == "CLEAR") {
+				SearchTrace::clear();
+				out += "OK\n";
+			}
+			else if (!SearchTrace::dump(file, grid)) {
+				out += "ERR could not write " + file + "\n";
+			}
+			else {
+				out += "OK\n";
+			}
+		}
+		else if (command == "LIMIT") {
+			long long bytes;
+			if (!(request >> bytes) || bytes < 0) {
+				out += "ERR expected LIMIT <bytes>\n";
+				return;
+			}
+			memory_limit = size_t(bytes);
+			out += "OK\n";
+		}
+		else if (command == "STATS") {
+			out += "STATS queries=" + std::to_string(num_queries) + " found=" + std::to_string(num_found)
+				+ " sets=" + std::to_string(num_sets) + " search_us=" + std::to_string(search_us) + "\n";
+		}
+		else {
+			out += "ERR unknown command " + command + "\n";
+		}
+	} // handleLine()
+
+private:
+
+	// Returns the subgoal graph of grid, building it first if there is none
+	SubgoalGraph& subgoalGraph() {
+		if (!subgoal_graph) {
+			subgoal_graph.reset(new SubgoalGraph(grid));
+		}
+		return *subgoal_graph;
+	} // subgoalGraph()
+
+	// Handles RESERVE <time> <cells...> and RESERVE CLEAR; request has already had the
+	// command read from it
+	void handleReserve(std::istringstream& request, std::string& out) {
+		std::string time;
+		if (!(request >> time)) {
+			out += "ERR expected RESERVE <time> <row> <col> ... or RESERVE CLEAR\n";
+			return;
+		}
+		if (time == "CLEAR") {
+			reservations.clear();
+			out += "OK\n";
+			return;
+		}
+		// The time must be a whole non-negative number with nothing after it
+		std::istringstream time_in(time);
+		int start_time;
+		char extra;
+		if (!(time_in >> start_time) || time_in >> extra || start_time < 0) {
+			out += "ERR expected RESERVE <time> <row> <col> ... or RESERVE CLEAR\n";
+			return;
+		}
+		std::vector<Coordinate> path;
+		Coordinate cell;
+		while (request >> cell.row >> cell.col) {
+			if (!grid.inBounds(cell)) {
+				out += "ERR cell out of bounds\n";
+				return;
+			}
+			path.push_back(cell);
+		}
+		if (path.empty()) {
+			out += "ERR expected RESERVE <time> <row> <col> ... or RESERVE CLEAR\n";
+			return;
+		}
+		reservations.reservePath(path, start_time);
+		out += "OK\n";
+	} // handleReserve()
+
+	// Handles CPD BUILD/SAVE/LOAD; request has already had the command read from it
+	void handleDatabase(std::istringstream& request, std::string& out) {
+		std::string action;
+		request >> action;
+		if (action == "BUILD") {
+			std::vector<Coordinate> keys;
+			Coordinate key;
+			while (request >> key.row >> key.col) {
+				if (!grid.inBounds(key) || !grid.isWalkable(grid.index(key))) {
+					out += "ERR invalid key cell\n";
+					return;
+				}
+				keys.push_back(key);
+			}
+			if (keys.empty()) {
+				out += "ERR expected CPD BUILD <row> <col> ...\n";
+				return;
+			}
+			path_database.reset(new PathDatabase(grid, keys));
+			out += "OK\n";
+			return;
+		}
+		std::string file;
+		if (!(request >> file) || (action != "SAVE" && action != "LOAD")) {
+			out += "ERR expected CPD <BUILD|SAVE|LOAD> ...\n";
+			return;
+		}
+		if (action == "SAVE" && (!path_database || !path_database->save(file))) {
+			out += "ERR could not write " + file + "\n";
+			return;
+		}
+		if (action == "LOAD") {
+			std::unique_ptr<PathDatabase> loaded(new PathDatabase(grid));
+			if (!loaded->load(file)) {
+				out += "ERR could not load a path database for this map from " + file + "\n";
+				return;
+			}
+			path_database = std::move(loaded);
+		}
+		out += "OK\n";
+	} // handleDatabase()
+
+	// Handles AGENTS <weight> <starts and goals...>; request has already had the command read
+	// from it
+	void handleAgents(std::istringstream& request, std::string& out) {
+		double weight;
+		std::vector<Coordinate> starts, goals;
+		Coordinate start, goal;
+		if (!(request >> weight) || weight < 1) {
+			out += "ERR expected AGENTS <weight> <r0> <c0> <r1> <c1> ...\n";
+			return;
+		}
+		while (request >> start.row >> start.col >> goal.row >> goal.col) {
+			starts.push_back(start);
+			goals.push_back(goal);
+		}
+		// Every start and goal must be walkable, and no two agents may share one
+		std::set<std::pair<int, int>> used_starts, used_goals;
+		bool valid = !starts.empty();
+		for (size_t i = 0; valid && i < starts.size(); ++i) {
+			valid = grid.inBounds(starts[i]) && grid.inBounds(goals[i]) && grid.isWalkable(grid.index(starts[i]))
+				&& grid.isWalkable(grid.index(goals[i])) && used_starts.insert({ starts[i].row, starts[i].col }).second
+				&& used_goals.insert({ goals[i].row, goals[i].col }).second;
+		}
+		if (!valid) {
+			out += "ERR invalid start or goal coordinate\n";
+			return;
+		}
+
+		auto t_start = std::chrono::steady_clock::now();
+		CBS cbs(grid, starts, goals, weight);
+		MultiPathResult result = cbs.solve(nullptr, agents_seconds);
+		auto t_end = std::chrono::steady_clock::now();
+		search_us += std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
+		++num_queries;
+		if (cbs.timedOut()) {
+			out += "ERR time limit exceeded after examining " + std::to_string(result.num_v_explored) + " cells\n";
+			return;
+		}
+		if (result.paths.empty()) {
+			out += "NOPATH " + std::to_string(result.num_v_explored) + "\n";
+			return;
+		}
+		++num_found;
+		out += "PATHS " + std::to_string(result.paths.size()) + " " + std::to_string(result.num_v_explored);
+		for (const std::vector<Coordinate>& path : result.paths) {
+			out += " | " + std::to_string(path.size() - 1);
+			appendPath(path, out);
+		}
+		out += "\n";
+	} // handleAgents()
+
+	// Runs the requested planner between start and goal and appends the compact result to out
+	void handleQuery(const std::string& algorithm, const Coordinate& start, const Coordinate& goal,
+		std::string& out) {
+		if (!grid.inBounds(start) || !grid.inBounds(goal)
+			|| !grid.isWalkable(grid.index(start)) || !grid.isWalkable(grid.index(goal))) {
+			out += "ERR invalid start or goal coordinate\n";
+			return;
+		}
+
+		auto t_start = std::chrono::steady_clock::now();
+		PathResult result;
+		// Set if a memory-bounded planner gave up before finishing its search
+		bool memory_exceeded = false;
+		if (algorithm == "astar") {
+			result = AStar(grid, start, goal).plan();
+		}
+		else if (algorithm == "dijkstra") {
+			result = Dijkstra(grid, start, goal).plan();
+		}
+		else if (algorithm == "bfs") {
+			result = BreadthDepthSearch(grid, start, goal).planBFS();
+		}
+		else if (algorithm == "dfs") {
+			result = BreadthDepthSearch(grid, start, goal).planDFS();
+		}
+		else if (algorithm == "greedy") {
+			result = GreedyBestFS(grid, start, goal).plan();
+		}
+		else if (algorithm == "fringe") {
+			FringeSearch fringe(grid, start, goal, memory_limit);
+			result = fringe.plan();
+			memory_exceeded = fringe.memoryExceeded();
+		}
+		else if (algorithm == "idastar") {
+			IDAStar ida(grid, start, goal, memory_limit);
+			result = ida.plan();
+			memory_exceeded = ida.memoryExceeded();
+		}
+		else if (algorithm == "subgoal") {
+			result = subgoalGraph().plan(start, goal);
+		}
+		else if (algorithm == "quadtree") {
+			if (!quadtree) {
+				quadtree.reset(new QuadtreeMap(grid));
+			}
+			result = quadtree->plan(start, goal);
+		}
+		else if (algorithm == "sipp") {
+			if (!reservations.isBuilt()) {
+				reservations.build();
+			}
+			result = SIPP(grid, reservations, start, goal).plan();
+		}
+		else if (algorithm == "theta") {
+			if (!walkable_mask) {
+				walkable_mask.reset(new WalkableMask(grid));
+			}
+			result = LazyThetaStar(grid, *walkable_mask, start, goal).plan();
+		}
+		else if (algorithm == "cpd") {
+			if (!path_database) {
+				out += "ERR no path database; use CPD BUILD or CPD LOAD first\n";
+				return;
+			}
+			result = path_database->plan(start, goal);
+		}
+		else if (algorithm == "portfolio") {
+			result = PlannerPortfolio(grid, start, goal).run(PlannerPortfolio::Mode::first_found).result;
+		}
+		else if (algorithm == "portfolio_optimal") {
+			result = PlannerPortfolio(grid, start, goal).run(PlannerPortfolio::Mode::first_optimal).result;
+		}
+		else {
+			out += "ERR unknown algorithm " + algorithm + "\n";
+			return;
+		}
+		auto t_end = std::chrono::steady_clock::now();
+		search_us += std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
+		++num_queries;
+
+		if (memory_exceeded) {
+			out += "ERR memory limit exceeded after examining " + std::to_string(result.num_v_explored) + " cells\n";
+			return;
+		}
+		if (result.path.empty()) {
+			out += "NOPATH " + std::to_string(result.num_v_explored) + "\n";
+			return;
+		}
+		++num_found;
+		out += "PATH " + std::to_string(result.path.size() - 1) + " " + std::to_string(result.num_v_explored);
+		appendPath(result.path, out);
+		out += "\n";
+	} // handleQuery()
+
+	// Runs one multi-goal search from start and appends the paths to the k nearest goals to out
+	void handleNearest(const std::string& algorithm, const Coordinate& start,
+		const std::vector<Coordinate>& goals, size_t k, std::string& out) {
+		bool valid = grid.inBounds(start) && grid.isWalkable(grid.index(start)) && !goals.empty() && k > 0;
+		for (const Coordinate& goal : goals) {
+			valid = valid && grid.inBounds(goal) && grid.isWalkable(grid.index(goal));
+		}
+		if (!valid) {
+			out += "ERR invalid start or goal coordinate\n";
+			return;
+		}
+
+		auto t_start = std::chrono::steady_clock::now();
+		MultiPathResult result;
+		if (algorithm == "astar") {
+			result = AStar(grid, start, goals, k).planGoals();
+		}
+		else if (algorithm == "dijkstra") {
+			result = Dijkstra(grid, start, goals, k).planGoals();
+		}
+		else if (algorithm == "bfs") {
+			result = BreadthDepthSearch(grid, start, goals, k).planBFSGoals();
+		}
+		else {
+			out += "ERR unknown algorithm " + algorithm + "\n";
+			return;
+		}
+		auto t_end = std::chrono::steady_clock::now();
+		search_us += std::chrono::duration_cast<std::chrono::microseconds>(t_end - t_start).count();
+		++num_queries;
+		if (!result.paths.empty()) {
+			++num_found;
+		}
+
+		out += "PATHS " + std::to_string(result.paths.size()) + " " + std::to_string(result.num_v_explored);
+		for (const std::vector<Coordinate>& path : result.paths) {
+			out += " | " + std::to_string(path.size() - 1);
+			appendPath(path, out);
+		}
+		out += "\n";
+	} // handleNearest()
+
+	// Appends the cells of path to out as " <row>,<col>" pairs
+	static void appendPath(const std::vector<Coordinate>& path, std::string& out) {
+		for (const Coordinate& c : path) {
+			out += " " + std::to_string(c.row) + "," + std::to_string(c.col);
+		}
+	} // appendPath()
+
+#ifndef _WIN32
+	// Answers requests from one connected client until it disconnects; every complete line
+	// received in a read is answered, and the responses are sent back with a single write
+	void serveConnection(int client_fd) {
+		std::string pending, responses;
+		char buf[4096];
+		ssize_t n;
+		while ((n = read(client_fd, buf, sizeof(buf))) > 0) {
+			pending.append(buf, size_t(n));
+			size_t line_begin = 0, line_end;
+			while ((line_end = pending.find('\n', line_begin)) != std::string::npos) {
+				handleLine(pending.substr(line_begin, line_end - line_begin), responses);
+				line_begin = line_end + 1;
+			}
+			pending.erase(0, line_begin);
+			if (!writeAll(client_fd, responses)) {
+				return;
+			}
+			responses.clear();
+		}
+	} // serveConnection()
+
+	// Writes all of data to fd; returns false if the client went away
+	static bool writeAll(int fd, const std::string& data) {
+		size_t written = 0;
+		while (written < data.size()) {
+			ssize_t n = write(fd, data.data() + written, data.size() - written);
+			if (n <= 0) {
+				return false;
+			}
+			written += size_t(n);
+		}
+		return true;
+	} // writeAll()
+#endif
+
+}; // class QueryServer
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <climits>
+#include <algorithm>
+#include "structs.h"
+#include "reservation_table.h"
+
+
+// Implementation of Safe Interval Path Planning (SIPP); finds the earliest arrival at goal
+// for an agent that must not meet the agents in a reservation table, either in a cell or by
+// swapping places with one. Instead of searching every (cell, time) pair, each cell's timeline
+// is split into safe intervals, the gaps between its reservations, and A* searches over
+// (cell, safe interval) states with the earliest arrival time as g_score. Waiting is implied
+// by arriving later than the earliest possible time, so a cell nobody passes through is a
+// single state, as in static A*
+class SIPP {
+private:
+
+	// Entry in open_list; f_score is stored with the entry so the heap never reads a value
+	// that has changed since the entry was pushed
+	struct OpenEntry {
+
+		// Sum of estimated time to goal and arrival time
+		int f_score;
+
+		// Id of the (cell, safe interval) state
+		uint32_t s;
+
+	}; // OpenEntry struct
+
+	// Functor to compare two open list entries; returns true if entry a's f is greater
+	// than entry b's f
+	class FComp {
+	public:
+
+		bool operator()(const OpenEntry& a, const OpenEntry& b) {
+			return a.f_score > b.f_score;
+		}
+	}; // class FComp
+
+
+// ---------- Member variables ----------
+
+	// Map shared with the other planners; vertex types are read from here
+	const Grid& grid;
+
+	// Times at which cells are taken by other agents
+	const ReservationTable& table;
+
+	// Parent state, earliest arrival time (g_score), and in_open/closed flags of every
+	// state. Cell v with n reserved intervals has the n + 1 safe intervals before, between,
+	// and after them; its i-th safe interval is state table.firstInterval(v) + v + i
+	SearchState state;
+
+	// Cell of every state, filled in as states are reached
+	std::vector<uint32_t> state_cell;
+
+	// Used for printing the path; filled in by reconstructPath()
+	std::vector<std::vector<Cell>> map;
+
+	// Min f_score priority queue; contains states that still need to be explored
+	std::priority_queue<OpenEntry, std::vector<OpenEntry>, FComp> open_list;
+
+	// Finds the earliest arrival at goal for an agent at start at time start_time
+	Coordinate start;
+
+	Coordinate goal;
+
+	int start_time;
+
+	// State goal was reached in, or no_parent
+	uint32_t goal_state = SearchState::no_parent;
+
+	// Set by plan(); search() gives up as soon as it is cancelled
+	const CancelToken* cancel = nullptr;
+
+	// Number of states explored
+	int num_v_explored = 0;
+
+	// Number of time steps from start_time to the arrival at goal
+	int total_path_length = 0;
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor; table must have been built after its last reservation
+	SIPP(const Grid& grid_in, const ReservationTable& table_in, const Coordinate& start_in,
+		const Coordinate& goal_in, int start_time_in = 0)
+		: grid{ grid_in }, table{ table_in }, state{ grid_in.size() + table_in.size(), true },
+		state_cell(grid_in.size() + table_in.size(), SearchState::no_parent),
+		start{ start_in }, goal{ goal_in }, start_time{ start_time_in } {
+		// Checks that start and goal are walkable spaces
+		if (!grid.isWalkable(grid.index(start)) || !grid.isWalkable(grid.index(goal))) {
+			std::cerr << "Invalid start or goal coordinate\n";
+			exit(1);
+		}
+		if (!table.isBuilt()) {
+			std::cerr << "Reservation table must be built before planning\n";
+			exit(1);
+		}
+	} // SIPP()
+
+	// Uses SIPP to find the earliest arrival at goal
+	std::vector<std::vector<Cell>> findPath() {
+		search();
+		// Backtrack from goal to start to find the path between start and goal
+		reconstructPath();
+		// Print data describing path
+		printData();
+
+		return map;
+	} // findPath()
+
+	// Same as findPath(), but prints nothing and returns the agent's cell at every time step
+	// instead of a map: path[i] is its cell at time start_time + i, so waits repeat a cell. The
+	// search gives up early if cancel_in is set
+	PathResult plan(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search()) {
+			return { {}, num_v_explored, true };
+		}
+		return { timedPath(), num_v_explored };
+	} // plan()
+
+private:
+
+	// Runs SIPP until goal is reached in its last safe interval or open_list is empty; returns
+	// false if it was cancelled first
+	bool search() {
+		uint32_t v_start = grid.index(start);
+		uint32_t v_goal = grid.index(goal);
+		uint32_t s_start = safeStateAt(v_start, start_time);
+		if (s_start == SearchState::no_parent) {
+			// start is taken at start_time
+			return true;
+		}
+		state.g_score[s_start] = start_time;
+		state_cell[s_start] = v_start;
+		open_list.push({ start_time + calculateH(v_start), s_start });
+		state.set(s_start, SearchState::in_open);
+
+		while (!open_list.empty()) {
+			// Stop early if the search has been cancelled
+			if (isCancelled(cancel)) {
+				return false;
+			}
+			// Get state with lowest f_score out of open_list
+			uint32_t s_min = open_list.top().s;
+			open_list.pop();
+			state.reset(s_min, SearchState::in_open);
+			if (state.test(s_min, SearchState::closed)) {
+				continue;
+			}
+			state.set(s_min, SearchState::closed);
+
+			// The agent can only stop at goal if nobody comes through after it arrives
+			uint32_t v = state_cell[s_min];
+			if (v == v_goal && safeEnd(s_min) == ReservationTable::forever) {
+				goal_state = s_min;
+				break;
+			}
+			updateAdj(s_min);
+		}
+		return true;
+	} // search()
+
+	// Estimates the time to get from v to goal
+	int calculateH(uint32_t v) {
+		Coordinate loc = grid.coord(v);
+		int x_dist = abs(goal.col - loc.col);
+		int y_dist = abs(goal.row - loc.row);
+		return x_dist + y_dist;
+	} // calculateH()
+
+
+	void updateAdj(uint32_t s) {
+		uint32_t v = state_cell[s];
+		Coordinate loc = grid.coord(v);
+
+		// Above vertex
+		// Check for out of bounds indexing
+		if (loc.row != 0) {
+			updateV(s, grid.above(v));
+		}
+
+		// Below vertex
+		if (loc.row != grid.numRows() - 1) {
+			updateV(s, grid.below(v));
+		}
+
+		// Left vertex
+		if (loc.col != 0) {
+			updateV(s, grid.left(v));
+		}
+
+		// Right vertex
+		if (loc.col != grid.numCols() - 1) {
+			updateV(s, grid.right(v));
+		}
+	} // updateAdj()
+
+	// Helper function for updateAdj(); the agent can leave v at any time from its arrival
+	// until the end of its safe interval, and reaches adj_v one step later, so every safe
+	// interval of adj_v that overlaps that window is reachable
+	void updateV(uint32_t s, uint32_t adj_v) {
+		if (!grid.isWalkable(adj_v)) {
+			return;
+		}
+		uint32_t v = state_cell[s];
+		int earliest = state.g_score[s] + 1;
+		int latest = safeEnd(s) == ReservationTable::forever ? ReservationTable::forever : safeEnd(s) + 1;
+		uint32_t first = table.firstInterval(adj_v) + adj_v;
+		for (uint32_t i = 0; i <= table.numIntervals(adj_v); ++i) {
+			uint32_t adj_s = first + i;
+			int begin = safeBegin(adj_v, i);
+			int end = safeEnd(adj_v, i);
+			// Intervals start later and later; nothing is safe after a reservation that never ends
+			if (begin > latest || begin == ReservationTable::forever) {
+				break;
+			}
+			// Arrive as early as both intervals allow, later if the agent would swap places
+			// with a reserved agent coming the other way
+			int arrival = std::max(earliest, begin);
+			int last = std::min(latest, end);
+			while (arrival <= last && table.isMoveReserved(adj_v, v, arrival - 1)) {
+				++arrival;
+			}
+			if (arrival > last || state.test(adj_s, SearchState::closed) || arrival >= state.g_score[adj_s]) {
+				continue;
+			}
+			++num_v_explored;
+			state.g_score[adj_s] = arrival;
+			state.parent[adj_s] = s;
+			state_cell[adj_s] = adj_v;
+			open_list.push({ arrival + calculateH(adj_v), adj_s });
+			state.set(adj_s, SearchState::in_open);
+		}
+	} // updateV()
+
+	// First and last time of safe interval i of cell v; the interval is empty if the first is
+	// after the last
+	int safeBegin(uint32_t v, uint32_t i) const {
+		if (i == 0) {
+			return 0;
+		}
+		int reserved_end = table.interval(table.firstInterval(v) + i - 1).end;
+		return reserved_end == ReservationTable::forever ? ReservationTable::forever : reserved_end + 1;
+	} // safeBegin()
+
+	int safeEnd(uint32_t v, uint32_t i) const {
+		if (i == table.numIntervals(v)) {
+			return ReservationTable::forever;
+		}
+		return table.interval(table.firstInterval(v) + i).begin - 1;
+	} // safeEnd()
+
+	// Last time of the safe interval of state s
+	int safeEnd(uint32_t s) const {
+		uint32_t v = state_cell[s];
+		return safeEnd(v, s - table.firstInterval(v) - v);
+	} // safeEnd()
+
+	// State of the safe interval of cell v that contains time t, or no_parent if v is
+	// reserved at t
+	uint32_t safeStateAt(uint32_t v, int t) const {
+		for (uint32_t i = 0; i <= table.numIntervals(v); ++i) {
+			if (safeBegin(v, i) <= t && t <= safeEnd(v, i)) {
+				return table.firstInterval(v) + v + i;
+			}
+		}
+		return SearchState::no_parent;
+	} // safeStateAt()
+
+	// Cell of the agent at every time step from start_time to its arrival at goal; empty if
+	// goal was not reached
+	std::vector<Coordinate> timedPath() const {
+		std::vector<Coordinate> path;
+		if (goal_state == SearchState::no_parent) {
+			return path;
+		}
+		std::vector<uint32_t> chain;
+		for (uint32_t s = goal_state; s != SearchState::no_parent; s = state.parent[s]) {
+			chain.push_back(s);
+		}
+		std::reverse(chain.begin(), chain.end());
+		// The agent waits in each state's cell from its arrival until one step before it
+		// arrives in the next state
+		for (size_t i = 0; i < chain.size(); ++i) {
+			int arrival = state.g_score[chain[i]];
+			int leave = i + 1 < chain.size() ? state.g_score[chain[i + 1]] - 1 : arrival;
+			for (int t = arrival; t <= leave; ++t) {
+				path.push_back(grid.coord(state_cell[chain[i]]));
+			}
+		}
+		return path;
+	} // timedPath()
+
+	// Marks each cell on the path found between start and goal as "path"
+	void reconstructPath() {
+		map = grid.toMap();
+		std::vector<Coordinate> path = timedPath();
+		if (path.empty()) {
+			std::cout << "No path found\n";
+			return;
+		}
+		total_path_length = int(path.size()) - 1;
+		// Leave start and goal marked as they are
+		for (size_t i = 1; i + 1 < path.size(); ++i) {
+			if (!(path[i] == start) && !(path[i] == goal)) {
+				map[path[i].row][path[i].col] = Cell::path;
+			}
+		}
+	} // reconstructPath()
+
+	// Prints out data describing path
+	void printData() const {
+		std::cout << "SIPP path \n";
+		std::cout << "Reserved intervals: " << table.size() << "\n";
+		std::cout << "States examined: " << num_v_explored << "\n";
+		std::cout << "Arrival time: " << total_path_length << "\n\n";
+	} // printData()
+
+
+}; // class SIPP
@@ -2,6 +2,11 @@
 
 #include <vector>
 #include <iostream>
+#include <cstdint>
+#include <climits>
+#include <atomic>
+#include <memory>
+#include <algorithm>
 
 // Contains data structures and helper functions used in every path planning algorithm
 
@@ -16,7 +21,7 @@
 #define CYAN    "\033[36m"      /* Cyan */
 #define WHITE   "\033[37m"      /* White */
 
-enum class Cell {
+enum class Cell : uint8_t {
 	obstacle,
 	walkable,
 	path, 
@@ -32,6 +37,477 @@ struct Coordinate {
 	}
 };
 
+// Order in which a Grid stores its cells; every per-cell search array is indexed by the grid's
+// cell index, so it follows the same order
+enum class Layout {
+	// Row after row; a step up or down jumps a whole row
+	row_major,
+	// Square tiles stored one after another, each tile row-major, and the tiles row-major;
+	// most steps up or down stay inside a tile
+	tiled,
+	// Z-order (Morton order); the bits of the row and column are interleaved, so cells that
+	// are close on the map are close in memory at every scale
+	morton
+};
+
+// Moves the low 16 bits of x to the even bit positions
+inline uint32_t spreadBits(uint32_t x) {
+	x &= 0xFFFF;
+	x = (x | (x << 8)) & 0x00FF00FF;
+	x = (x | (x << 4)) & 0x0F0F0F0F;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+	return x;
+}
+
+// Inverse of spreadBits(); gathers the even bits of x into the low 16 bits
+inline uint32_t compactBits(uint32_t x) {
+	x &= 0x55555555;
+	x = (x | (x >> 1)) & 0x33333333;
+	x = (x | (x >> 2)) & 0x0F0F0F0F;
+	x = (x | (x >> 4)) & 0x00FF00FF;
+	x = (x | (x >> 8)) & 0x0000FFFF;
+	return x;
+}
+
+// Z-order key of a row and column below 2^16: column bits at the even positions and row bits
+// at the odd ones. The Morton layout of Grid and the files of PathDatabase both use this order
+inline uint32_t interleaveBits(uint32_t row, uint32_t col) {
+	return spreadBits(col) | spreadBits(row) << 1;
+}
+
+// Flat copy of the map that is shared by every planner; each cell is addressed by a 32-bit
+// index whose meaning depends on the layout. With the default row-major layout the index is
+// row * cols + col. Tiled and Morton layouts pad the map with obstacles up to whole tiles or
+// powers of two, so size() can be larger than rows * cols. Planners move between cells with
+// above(), below(), left(), and right() rather than index arithmetic.
+// By default the cells are stored in one flat array. A grid built with chunked_in set instead
+// stores them in chunks of consecutive indices that copies of the grid share, so a copy costs
+// one pointer per chunk; setType() copies a chunk the first time it writes to one that another
+// grid still uses. In the tiled layout a chunk is a run of whole tiles (one tile with 64 x 64
+// tiles), and in the Morton layout a 64 x 64 square. Reading a chunked cell costs one more
+// dependent load, so only grids that are copied often, like the snapshots of a MapStore, use
+// chunks
+class Grid {
+private:
+
+	// log2 of the number of cells in a chunk
+	static constexpr int chunk_shift = 12;
+
+	static constexpr uint32_t chunk_mask = (1u << chunk_shift) - 1;
+
+	// Cell types in layout order of a grid that is not chunked. data points at cells, and is
+	// null for a chunked grid, so reading a cell tests the same pointer it then reads through
+	struct FlatCells {
+
+		std::vector<Cell> cells;
+
+		Cell* data = nullptr;
+
+		FlatCells() = default;
+
+		FlatCells(const FlatCells& other)
+			: cells{ other.cells }, data{ other.data ? cells.data() : nullptr } {}
+
+		FlatCells(FlatCells&& other) = default;
+
+		FlatCells& operator=(const FlatCells& other) {
+			cells = other.cells;
+			data = other.data ? cells.data() : nullptr;
+			return *this;
+		}
+
+		FlatCells& operator=(FlatCells&& other) = default;
+
+	}; // struct FlatCells
+
+	FlatCells flat;
+
+	// Chunks of cell types in layout order, and the cells of each chunk, kept beside them so
+	// reading a cell costs a single extra load; empty if the grid is not chunked
+	std::vector<std::shared_ptr<std::vector<Cell>>> chunks;
+
+	std::vector<Cell*> chunk_cells;
+
+	// Number of cells, including padding but not the unused end of the last chunk
+	uint32_t num_cells = 0;
+
+	int rows = 0;
+
+	int cols = 0;
+
+	Layout layout;
+
+	// log2 of the side of a tile in the tiled layout
+	int tile_shift = 0;
+
+	// Cells from the start of one row of tiles to the start of the next, in the tiled layout
+	uint32_t tile_row_stride = 0;
+
+	// Bits of a Morton index that hold the column and the row; a step left or right only
+	// changes the column bits, so it can be done with a masked add
+	uint32_t col_bits = 0;
+
+	uint32_t row_bits = 0;
+
+	// Number of low bits of both row and column that are interleaved in a Morton index; the
+	// remaining bits of the longer side sit above them
+	int morton_shift = 0;
+
+	// Set if the bits above the interleaved ones belong to the row rather than the column
+	bool morton_high_row = false;
+
+public:
+
+	// Constructor; tile_size is the side of a tile in the tiled layout and must be a power of
+	// two, and chunked_in stores the cells in chunks that copies share
+	Grid(const std::vector<std::vector<Cell>>& map_in, Layout layout_in = Layout::row_major, int tile_size = 8,
+		bool chunked_in = false)
+		: rows{ int(map_in.size()) }, cols{ int(map_in[0].size()) }, layout{ layout_in } {
+		size_t storage = size_t(rows) * cols;
+		if (layout == Layout::tiled) {
+			while ((1 << tile_shift) < tile_size) {
+				++tile_shift;
+			}
+			uint32_t tile_side = 1u << tile_shift;
+			uint32_t tiles_per_row = (uint32_t(cols) + tile_side - 1) >> tile_shift;
+			uint32_t tile_rows = (uint32_t(rows) + tile_side - 1) >> tile_shift;
+			tile_row_stride = tiles_per_row << (2 * tile_shift);
+			storage = size_t(tile_rows) * tile_row_stride;
+		}
+		else if (layout == Layout::morton) {
+			int row_shift = 0, col_shift = 0;
+			while ((1 << row_shift) < rows) {
+				++row_shift;
+			}
+			while ((1 << col_shift) < cols) {
+				++col_shift;
+			}
+			morton_shift = std::min(row_shift, col_shift);
+			morton_high_row = row_shift > col_shift;
+			col_bits = index({ 0, (1 << col_shift) - 1 });
+			row_bits = index({ (1 << row_shift) - 1, 0 });
+			storage = size_t(1) << (row_shift + col_shift);
+		}
+
+		num_cells = uint32_t(storage);
+		if (!chunked_in) {
+			flat.cells.assign(storage, Cell::obstacle);
+			flat.data = flat.cells.data();
+		}
+		for (size_t first = 0; chunked_in && first < storage; first += chunk_mask + 1) {
+			chunks.push_back(std::make_shared<std::vector<Cell>>(chunk_mask + 1, Cell::obstacle));
+			chunk_cells.push_back(chunks.back()->data());
+		}
+		for (int r = 0; r < rows; ++r) {
+			for (int c = 0; c < cols; ++c) {
+				uint32_t idx = index({ r, c });
+				cellRef(idx) = map_in[r][c];
+			}
+		}
+	} // Grid()
+
+	int numRows() const {
+		return rows;
+	}
+
+	int numCols() const {
+		return cols;
+	}
+
+	Layout cellLayout() const {
+		return layout;
+	}
+
+	// Total number of cells stored, including any padding; every cell index is below this
+	uint32_t size() const {
+		return num_cells;
+	}
+
+	// Returns the index of the cell at c
+	uint32_t index(const Coordinate& c) const {
+		switch (layout) {
+		case Layout::tiled: {
+			uint32_t mask = (1u << tile_shift) - 1;
+			return (uint32_t(c.row) >> tile_shift) * tile_row_stride + ((uint32_t(c.col) >> tile_shift) << (2 * tile_shift))
+				+ ((uint32_t(c.row) & mask) << tile_shift) + (uint32_t(c.col) & mask);
+		}
+		case Layout::morton: {
+			uint32_t low_mask = (1u << morton_shift) - 1;
+			uint32_t low = interleaveBits(uint32_t(c.row) & low_mask, uint32_t(c.col) & low_mask);
+			// Only one of these is non-zero, since the shorter side fits in the low bits
+			uint32_t high = (uint32_t(c.row) >> morton_shift) | (uint32_t(c.col) >> morton_shift);
+			return low | high << (2 * morton_shift);
+		}
+		default:
+			return uint32_t(c.row) * cols + c.col;
+		}
+	}
+
+	// Returns the row and column of the cell at idx
+	Coordinate coord(uint32_t idx) const {
+		switch (layout) {
+		case Layout::tiled: {
+			uint32_t mask = (1u << tile_shift) - 1;
+			uint32_t tile_row = idx / tile_row_stride;
+			uint32_t in_row = idx % tile_row_stride;
+			uint32_t tile_col = in_row >> (2 * tile_shift);
+			return { int(tile_row << tile_shift | ((in_row >> tile_shift) & mask)),
+				int(tile_col << tile_shift | (in_row & mask)) };
+		}
+		case Layout::morton: {
+			uint32_t low_bits = (1u << (2 * morton_shift)) - 1;
+			uint32_t high = (idx & ~low_bits) >> morton_shift;
+			uint32_t row = compactBits(idx >> 1 & low_bits) | (morton_high_row ? high : 0);
+			uint32_t col = compactBits(idx & low_bits) | (morton_high_row ? 0 : high);
+			return { int(row), int(col) };
+		}
+		default:
+			return { int(idx / cols), int(idx % cols) };
+		}
+	}
+
+	// Index of the cell above, below, left of, or right of the cell at idx; only valid when
+	// that cell is inside the grid
+	uint32_t above(uint32_t idx) const {
+		switch (layout) {
+		case Layout::tiled: {
+			uint32_t row_mask = ((1u << tile_shift) - 1) << tile_shift;
+			return idx & row_mask ? idx - (1u << tile_shift) : idx - tile_row_stride + row_mask;
+		}
+		case Layout::morton:
+			return (((idx & row_bits) - 1) & row_bits) | (idx & col_bits);
+		default:
+			return idx - cols;
+		}
+	}
+
+	uint32_t below(uint32_t idx) const {
+		switch (layout) {
+		case Layout::tiled: {
+			uint32_t row_mask = ((1u << tile_shift) - 1) << tile_shift;
+			return (idx & row_mask) != row_mask ? idx + (1u << tile_shift) : idx + tile_row_stride - row_mask;
+		}
+		case Layout::morton:
+			return (((idx | ~row_bits) + 1) & row_bits) | (idx & col_bits);
+		default:
+			return idx + cols;
+		}
+	}
+
+	uint32_t left(uint32_t idx) const {
+		switch (layout) {
+		case Layout::tiled: {
+			uint32_t col_mask = (1u << tile_shift) - 1;
+			return idx & col_mask ? idx - 1 : idx - (1u << (2 * tile_shift)) + col_mask;
+		}
+		case Layout::morton:
+			return (((idx & col_bits) - 1) & col_bits) | (idx & row_bits);
+		default:
+			return idx - 1;
+		}
+	}
+
+	uint32_t right(uint32_t idx) const {
+		switch (layout) {
+		case Layout::tiled: {
+			uint32_t col_mask = (1u << tile_shift) - 1;
+			return (idx & col_mask) != col_mask ? idx + 1 : idx + (1u << (2 * tile_shift)) - col_mask;
+		}
+		case Layout::morton:
+			return (((idx | ~col_bits) + 1) & col_bits) | (idx & row_bits);
+		default:
+			return idx + 1;
+		}
+	}
+
+	Cell type(uint32_t idx) const {
+		const Cell* cells = flat.data;
+		return cells ? cells[idx] : chunk_cells[idx >> chunk_shift][idx & chunk_mask];
+	}
+
+	// In a chunked grid, copies the chunk holding idx first if another grid shares it, so the
+	// other grid never sees the change
+	void setType(uint32_t idx, Cell type_in) {
+		if (!flat.data) {
+			std::shared_ptr<std::vector<Cell>>& chunk = chunks[idx >> chunk_shift];
+			if (chunk.use_count() > 1) {
+				chunk = std::make_shared<std::vector<Cell>>(*chunk);
+				chunk_cells[idx >> chunk_shift] = chunk->data();
+			}
+		}
+		cellRef(idx) = type_in;
+	}
+
+	// True if the cells are stored in chunks that copies share
+	bool isChunked() const {
+		return !flat.data;
+	}
+
+	// Number of chunks this grid shares with other, a copy of the same map; 0 unless both
+	// are chunked
+	uint32_t numSharedChunks(const Grid& other) const {
+		uint32_t shared = 0;
+		for (size_t i = 0; i < chunks.size() && i < other.chunks.size(); ++i) {
+			shared += chunks[i] == other.chunks[i];
+		}
+		return shared;
+	}
+
+	// Number of chunks the cells are stored in; 0 if the grid is not chunked
+	uint32_t numChunks() const {
+		return uint32_t(chunks.size());
+	}
+
+	// Returns true if c lies inside the grid
+	bool inBounds(const Coordinate& c) const {
+		return c.row >= 0 && c.row < rows && c.col >= 0 && c.col < cols;
+	}
+
+	// Returns true if the cell at idx is either walkable, start, or goal
+	bool isWalkable(uint32_t idx) const {
+		Cell c = type(idx);
+		return c == Cell::walkable || c == Cell::start || c == Cell::goal;
+	}
+
+	// FNV-1a hash of the layout and of which cells are walkable; identifies the map a
+	// preprocessed file belongs to, since those files store cell indices
+	uint64_t checksum() const {
+		uint64_t hash = 14695981039346656037ull;
+		hash = (hash ^ (uint64_t(layout) << 8 | uint64_t(tile_shift))) * 1099511628211ull;
+		for (uint32_t v = 0; v < size(); ++v) {
+			hash = (hash ^ uint64_t(isWalkable(v))) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// Returns a 2D vector of cells with the same contents as the grid, used for printing
+	std::vector<std::vector<Cell>> toMap() const {
+		std::vector<std::vector<Cell>> map(rows, std::vector<Cell>(cols));
+		for (int r = 0; r < rows; ++r) {
+			for (int c = 0; c < cols; ++c) {
+				map[r][c] = type(index({ r, c }));
+			}
+		}
+		return map;
+	}
+
+private:
+
+	// Storage of the cell at idx
+	Cell& cellRef(uint32_t idx) {
+		return flat.data ? flat.data[idx] : chunk_cells[idx >> chunk_shift][idx & chunk_mask];
+	}
+
+}; // class Grid
+
+// State of a search that is run a slice at a time
+enum class SearchStatus {
+	// The search has more vertices to expand
+	in_progress,
+	// The search reached its goal
+	found,
+	// The search ran out of vertices without reaching its goal
+	failed
+};
+
+// Result of a query with several goals, answered from one search tree
+struct MultiPathResult {
+
+	// Path from start to each goal that was reached, in the order the goals were reached;
+	// the last cell of each path is its goal
+	std::vector<std::vector<Coordinate>> paths;
+
+	// Number of cells examined during the search
+	int num_v_explored = 0;
+
+	// True if the search was cancelled before it finished; paths is empty in that case
+	bool cancelled = false;
+
+}; // struct MultiPathResult
+
+// Cooperative cancellation flag; every planner's search loop checks it once per iteration and
+// gives up as soon as it is set
+using CancelToken = std::atomic<bool>;
+
+// Returns true if token is set; a null token is never cancelled
+inline bool isCancelled(const CancelToken* token) {
+	return token && token->load(std::memory_order_relaxed);
+}
+
+// Result of a planner query that prints nothing
+struct PathResult {
+
+	// Cells of the path from start to goal; empty if no path was found
+	std::vector<Coordinate> path;
+
+	// Number of cells examined during the search
+	int num_v_explored = 0;
+
+	// True if the search was cancelled before it finished; path is empty in that case
+	bool cancelled = false;
+
+}; // struct PathResult
+
+// Per-query search state shared by every planner, stored as parallel arrays indexed by cell
+// index instead of one Vertex struct per cell; the location of a cell is its index and its
+// type is read from the shared Grid
+struct SearchState {
+
+	// Parent index of a cell that has no preceding cell in the path
+	static constexpr uint32_t no_parent = UINT32_MAX;
+
+	// Bits stored in flags
+	static constexpr uint8_t in_open = 1 << 0;
+	static constexpr uint8_t closed = 1 << 1;
+	static constexpr uint8_t goal = 1 << 2;
+
+	// Index of the preceding cell in the path
+	std::vector<uint32_t> parent;
+
+	// Cost to get from start to each cell; left empty by planners that do not need it
+	std::vector<int> g_score;
+
+	// Packed in_open, closed, and goal bits of each cell
+	std::vector<uint8_t> flags;
+
+	SearchState(uint32_t num_cells, bool with_g_score)
+		: parent(num_cells, no_parent), flags(num_cells, 0) {
+		if (with_g_score) {
+			g_score.assign(num_cells, INT_MAX);
+		}
+	} // SearchState()
+
+	bool test(uint32_t idx, uint8_t flag) const {
+		return flags[idx] & flag;
+	}
+
+	void set(uint32_t idx, uint8_t flag) {
+		flags[idx] |= flag;
+	}
+
+	void reset(uint32_t idx, uint8_t flag) {
+		flags[idx] &= ~flag;
+	}
+
+	// Follows parent indices back from goal; returns the cells of the path from start to goal,
+	// or an empty vector if goal was never reached
+	std::vector<Coordinate> extractPath(const Grid& grid, uint32_t start, uint32_t goal) const {
+		std::vector<Coordinate> path;
+		uint32_t v_path = goal;
+		while (v_path != start) {
+			if (v_path == no_parent) {
+				return {};
+			}
+			path.push_back(grid.coord(v_path));
+			v_path = parent[v_path];
+		}
+		path.push_back(grid.coord(start));
+		return std::vector<Coordinate>(path.rbegin(), path.rend());
+	} // extractPath()
+
+}; // struct SearchState
+
 // Prints given 2D vector of cells to cout
 static void printMap(const std::vector<std::vector<Cell>>& map) {
 	for (int i = 0; i < map.size(); ++i) {
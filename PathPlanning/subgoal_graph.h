@@ -0,0 +1,402 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <string>
+#include <fstream>
+#include <climits>
+#include <algorithm>
+#include "structs.h"
+
+
+// Simple Subgoal Graph; preprocesses a static map so that shortest path queries only search a
+// small graph instead of the grid. Subgoals are placed next to obstacle corners, at every
+// walkable cell that has a blocked diagonal neighbor whose two shared orthogonal neighbors
+// are walkable; these are the only cells where a shortest 4-connected path has to change the
+// quadrant it is heading in. Two cells are h-reachable if some path between them has
+// Manhattan length, i.e. never moves away from the other cell, and subgoals are connected
+// when they are h-reachable without passing through another subgoal. A query connects start
+// and goal to the graph the same way, runs A* on the graph, and refines every graph edge back
+// into grid moves
+class SubgoalGraph {
+private:
+
+	// Node id used for cells that are not subgoals
+	static constexpr uint32_t no_subgoal = UINT32_MAX;
+
+	// Entry in the open list of a query
+	struct OpenEntry {
+
+		// Sum of estimated cost to goal and cost from start
+		int f_score;
+
+		// Id of the graph node
+		uint32_t node;
+
+	}; // OpenEntry struct
+
+	// Functor to compare two open list entries; returns true if entry a's f is greater
+	// than entry b's f
+	class FComp {
+	public:
+
+		bool operator()(const OpenEntry& a, const OpenEntry& b) {
+			return a.f_score > b.f_score;
+		}
+	}; // class FComp
+
+
+// ---------- Member variables ----------
+
+	// Map the graph was built for; must not change while the graph is in use
+	const Grid& grid;
+
+	// Cell index of each subgoal; a subgoal's position in this vector is its node id
+	std::vector<uint32_t> subgoals;
+
+	// Node id of each cell, or no_subgoal
+	std::vector<uint32_t> subgoal_id;
+
+	// Edges of the graph in compressed sparse row form; the neighbors of subgoal i are
+	// edges[edge_begin[i]] to edges[edge_begin[i + 1] - 1]
+	std::vector<uint32_t> edge_begin;
+
+	std::vector<uint32_t> edges;
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor; builds the graph for grid_in unless build_now is false, in which case the
+	// graph is empty until load() succeeds
+	SubgoalGraph(const Grid& grid_in, bool build_now = true)
+		: grid{ grid_in } {
+		if (build_now) {
+			build();
+		}
+	} // SubgoalGraph()
+
+	// Places the subgoals and connects every pair that is directly h-reachable
+	void build() {
+		subgoals.clear();
+		subgoal_id.assign(grid.size(), no_subgoal);
+		for (uint32_t v = 0; v < grid.size(); ++v) {
+			if (isSubgoalCell(v)) {
+				subgoal_id[v] = uint32_t(subgoals.size());
+				subgoals.push_back(v);
+			}
+		}
+
+		edge_begin.assign(1, 0);
+		edges.clear();
+		std::vector<uint32_t> adj;
+		bool unused;
+		for (uint32_t v : subgoals) {
+			adj.clear();
+			findDirectSubgoals(v, no_subgoal, adj, unused);
+			// Cells on the axes belong to two quadrants, so they can be found twice
+			std::sort(adj.begin(), adj.end());
+			adj.erase(std::unique(adj.begin(), adj.end()), adj.end());
+			edges.insert(edges.end(), adj.begin(), adj.end());
+			edge_begin.push_back(uint32_t(edges.size()));
+		}
+	} // build()
+
+	// Finds the shortest path between start and goal; prints the same data as the other
+	// planners and returns the map with the path marked
+	std::vector<std::vector<Cell>> findPath(const Coordinate& start, const Coordinate& goal) const {
+		PathResult result = plan(start, goal);
+		std::vector<std::vector<Cell>> map = grid.toMap();
+		if (result.path.empty()) {
+			std::cout << "No path found\n";
+		}
+		// Leave start and goal marked as they are
+		for (size_t i = 1; i + 1 < result.path.size(); ++i) {
+			map[result.path[i].row][result.path[i].col] = Cell::path;
+		}
+
+		std::cout << "Subgoal graph path \n";
+		std::cout << "Subgoals: " << subgoals.size() << ", edges: " << edges.size() / 2 << "\n";
+		std::cout << "Subgoals examined: " << result.num_v_explored << "\n";
+		std::cout << "Path length: " << (result.path.empty() ? 0 : result.path.size() - 1) << "\n\n";
+		return map;
+	} // findPath()
+
+	// Finds the shortest path between start and goal without printing anything; num_v_explored
+	// in the result counts graph nodes pushed into the open list. Safe to call from several
+	// threads at once
+	PathResult plan(const Coordinate& start, const Coordinate& goal) const {
+		uint32_t v_start = grid.index(start);
+		uint32_t v_goal = grid.index(goal);
+		if (!grid.isWalkable(v_start) || !grid.isWalkable(v_goal)) {
+			return {};
+		}
+
+		// Connect start to the graph; if goal is h-reachable from start, a path of Manhattan
+		// length exists and no graph search is needed
+		std::vector<uint32_t> start_adj;
+		bool goal_direct = false;
+		findDirectSubgoals(v_start, v_goal, start_adj, goal_direct);
+		if (goal_direct || v_start == v_goal) {
+			return { refine({ v_start, v_goal }), 0 };
+		}
+		std::vector<uint32_t> goal_adj;
+		bool unused;
+		findDirectSubgoals(v_goal, no_subgoal, goal_adj, unused);
+
+		// Run A* over the subgoals; node ids past the subgoals are start and goal
+		uint32_t num_subgoals = uint32_t(subgoals.size());
+		uint32_t start_node = num_subgoals;
+		uint32_t goal_node = num_subgoals + 1;
+		std::vector<int> g_score(num_subgoals + 2, INT_MAX);
+		std::vector<uint32_t> parent(num_subgoals + 2, SearchState::no_parent);
+		std::vector<char> closed(num_subgoals + 2, false);
+		std::vector<char> to_goal(num_subgoals, false);
+		for (uint32_t node : goal_adj) {
+			to_goal[node] = true;
+		}
+		std::priority_queue<OpenEntry, std::vector<OpenEntry>, FComp> open_list;
+		int num_v_explored = 0;
+
+		g_score[start_node] = 0;
+		open_list.push({ distance(v_start, v_goal), start_node });
+		while (!open_list.empty()) {
+			uint32_t node = open_list.top().node;
+			open_list.pop();
+			if (closed[node]) {
+				continue;
+			}
+			closed[node] = true;
+			if (node == goal_node) {
+				break;
+			}
+
+			uint32_t v = node == start_node ? v_start : subgoals[node];
+			auto relax = [&](uint32_t adj_node, uint32_t adj_v) {
+				int new_g_score = g_score[node] + distance(v, adj_v);
+				if (!closed[adj_node] && new_g_score < g_score[adj_node]) {
+					++num_v_explored;
+					g_score[adj_node] = new_g_score;
+					parent[adj_node] = node;
+					open_list.push({ new_g_score + distance(adj_v, v_goal), adj_node });
+				}
+			};
+			if (node == start_node) {
+				for (uint32_t adj_node : start_adj) {
+					relax(adj_node, subgoals[adj_node]);
+				}
+				continue;
+			}
+			for (uint32_t e = edge_begin[node]; e < edge_begin[node + 1]; ++e) {
+				relax(edges[e], subgoals[edges[e]]);
+			}
+			if (to_goal[node]) {
+				relax(goal_node, v_goal);
+			}
+		}
+
+		if (parent[goal_node] == SearchState::no_parent) {
+			return { {}, num_v_explored };
+		}
+		// Turn the chain of graph nodes into cells, from start to goal
+		std::vector<uint32_t> waypoints;
+		for (uint32_t node = goal_node; node != start_node; node = parent[node]) {
+			waypoints.push_back(node == goal_node ? v_goal : subgoals[node]);
+		}
+		waypoints.push_back(v_start);
+		std::reverse(waypoints.begin(), waypoints.end());
+		return { refine(waypoints), num_v_explored };
+	} // plan()
+
+	// Number of subgoals in the graph
+	size_t numSubgoals() const {
+		return subgoals.size();
+	} // numSubgoals()
+
+	// Writes the graph to a binary file; returns false if the file could not be written
+	bool save(const std::string& path) const {
+		std::ofstream out(path, std::ios::binary);
+		uint32_t header[4] = { file_magic, uint32_t(grid.numRows()), uint32_t(grid.numCols()),
+			uint32_t(subgoals.size()) };
+		uint64_t checksum = grid.checksum();
+		uint32_t num_edges = uint32_t(edges.size());
+		out.write((const char*)header, sizeof(header));
+		out.write((const char*)&checksum, sizeof(checksum));
+		out.write((const char*)&num_edges, sizeof(num_edges));
+		out.write((const char*)subgoals.data(), subgoals.size() * sizeof(uint32_t));
+		out.write((const char*)edge_begin.data(), edge_begin.size() * sizeof(uint32_t));
+		out.write((const char*)edges.data(), edges.size() * sizeof(uint32_t));
+		return bool(out);
+	} // save()
+
+	// Reads a graph written by save(); returns false and leaves the graph unchanged if the
+	// file cannot be read or was built for a different map
+	bool load(const std::string& path) {
+		std::ifstream in(path, std::ios::binary);
+		uint32_t header[4];
+		uint64_t checksum;
+		uint32_t num_edges;
+		in.read((char*)header, sizeof(header));
+		in.read((char*)&checksum, sizeof(checksum));
+		in.read((char*)&num_edges, sizeof(num_edges));
+		if (!in || header[0] != file_magic || header[1] != uint32_t(grid.numRows())
+			|| header[2] != uint32_t(grid.numCols()) || header[3] > grid.size()
+			|| checksum != grid.checksum()) {
+			return false;
+		}
+
+		std::vector<uint32_t> new_subgoals(header[3]);
+		std::vector<uint32_t> new_edge_begin(header[3] + 1);
+		std::vector<uint32_t> new_edges(num_edges);
+		in.read((char*)new_subgoals.data(), new_subgoals.size() * sizeof(uint32_t));
+		in.read((char*)new_edge_begin.data(), new_edge_begin.size() * sizeof(uint32_t));
+		in.read((char*)new_edges.data(), new_edges.size() * sizeof(uint32_t));
+		if (!in || new_edge_begin.back() != num_edges) {
+			return false;
+		}
+
+		subgoals = std::move(new_subgoals);
+		edge_begin = std::move(new_edge_begin);
+		edges = std::move(new_edges);
+		subgoal_id.assign(grid.size(), no_subgoal);
+		for (uint32_t i = 0; i < subgoals.size(); ++i) {
+			subgoal_id[subgoals[i]] = i;
+		}
+		return true;
+	} // load()
+
+private:
+
+	// First word of a saved graph file ("SSG1")
+	static constexpr uint32_t file_magic = 0x31475353;
+
+	// Returns true if (row, col) is inside the grid and walkable
+	bool isWalkableAt(int row, int col) const {
+		return grid.inBounds({ row, col }) && grid.isWalkable(grid.index({ row, col }));
+	} // isWalkableAt()
+
+	// Returns true if v is walkable and has a blocked diagonal neighbor whose two orthogonal
+	// neighbors shared with v are both walkable, i.e. v sits just off an obstacle corner
+	bool isSubgoalCell(uint32_t v) const {
+		if (!grid.isWalkable(v)) {
+			return false;
+		}
+		Coordinate loc = grid.coord(v);
+		for (int dr = -1; dr <= 1; dr += 2) {
+			for (int dc = -1; dc <= 1; dc += 2) {
+				Coordinate diag = { loc.row + dr, loc.col + dc };
+				if (grid.inBounds(diag) && !grid.isWalkable(grid.index(diag))
+					&& isWalkableAt(loc.row + dr, loc.col) && isWalkableAt(loc.row, loc.col + dc)) {
+					return true;
+				}
+			}
+		}
+		return false;
+	} // isSubgoalCell()
+
+	// Manhattan distance between two cells
+	int distance(uint32_t a, uint32_t b) const {
+		Coordinate loc_a = grid.coord(a);
+		Coordinate loc_b = grid.coord(b);
+		return abs(loc_a.row - loc_b.row) + abs(loc_a.col - loc_b.col);
+	} // distance()
+
+	// Appends to out the node ids of the subgoals that are h-reachable from src without
+	// passing through another subgoal; sets reached_target if target (a cell index, or
+	// no_subgoal) is h-reachable the same way. Each quadrant around src is swept row by row
+	// moving only away from src, so every cell reached has a path of Manhattan length
+	void findDirectSubgoals(uint32_t src, uint32_t target, std::vector<uint32_t>& out,
+		bool& reached_target) const {
+		reached_target = false;
+		Coordinate loc = grid.coord(src);
+		std::vector<char> prev, curr;
+		for (int dr = -1; dr <= 1; dr += 2) {
+			for (int dc = -1; dc <= 1; dc += 2) {
+				int width = dc > 0 ? grid.numCols() - loc.col : loc.col + 1;
+				prev.assign(width, false);
+				curr.assign(width, false);
+				// Last column offset that can be expanded from in the previous row
+				int last_prev = 0;
+				for (int k = 0, row = loc.row; row >= 0 && row < grid.numRows(); ++k, row += dr) {
+					int last_curr = -1;
+					for (int j = 0, col = loc.col; j < width; ++j, col += dc) {
+						bool from_prev = k > 0 && j <= last_prev && prev[j];
+						bool from_side = j > 0 && curr[j - 1];
+						curr[j] = false;
+						if (k == 0 && j == 0) {
+							curr[j] = true;
+						}
+						else if ((from_prev || from_side) && isWalkableAt(row, col)) {
+							uint32_t v = grid.index({ row, col });
+							if (v == target) {
+								reached_target = true;
+							}
+							// Subgoals are reached but not passed through
+							if (subgoal_id[v] != no_subgoal) {
+								out.push_back(subgoal_id[v]);
+							}
+							else {
+								curr[j] = true;
+							}
+						}
+						if (curr[j]) {
+							last_curr = j;
+						}
+						// Nothing further along this row can be reached
+						else if (!from_prev && j >= last_prev) {
+							break;
+						}
+					}
+					if (last_curr < 0) {
+						break;
+					}
+					last_prev = last_curr;
+					std::swap(prev, curr);
+				}
+			}
+		}
+	} // findDirectSubgoals()
+
+	// Expands consecutive h-reachable waypoints into the cells of a path between them;
+	// returns an empty path if some pair is not actually h-reachable
+	std::vector<Coordinate> refine(const std::vector<uint32_t>& waypoints) const {
+		std::vector<Coordinate> path = { grid.coord(waypoints[0]) };
+		std::vector<char> reach;
+		for (size_t w = 1; w < waypoints.size(); ++w) {
+			Coordinate a = grid.coord(waypoints[w - 1]);
+			Coordinate b = grid.coord(waypoints[w]);
+			int dr = b.row >= a.row ? 1 : -1;
+			int dc = b.col >= a.col ? 1 : -1;
+			int height = abs(b.row - a.row) + 1;
+			int width = abs(b.col - a.col) + 1;
+
+			// Mark every cell of the bounding box reachable from a by moving toward b
+			reach.assign(size_t(height) * width, false);
+			for (int i = 0; i < height; ++i) {
+				for (int j = 0; j < width; ++j) {
+					bool from_a = (i == 0 && j == 0)
+						|| (i > 0 && reach[size_t(i - 1) * width + j]) || (j > 0 && reach[size_t(i) * width + j - 1]);
+					reach[size_t(i) * width + j] = from_a && isWalkableAt(a.row + i * dr, a.col + j * dc);
+				}
+			}
+			if (!reach.back()) {
+				return {};
+			}
+
+			// Walk back from b to a through reachable cells
+			std::vector<Coordinate> segment;
+			for (int i = height - 1, j = width - 1; i > 0 || j > 0;) {
+				segment.push_back({ a.row + i * dr, a.col + j * dc });
+				if (i > 0 && reach[size_t(i - 1) * width + j]) {
+					--i;
+				}
+				else {
+					--j;
+				}
+			}
+			path.insert(path.end(), segment.rbegin(), segment.rend());
+		}
+		return path;
+	} // refine()
+
+}; // class SubgoalGraph
@@ -0,0 +1,404 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <algorithm>
+#include "structs.h"
+
+
+// One bit per cell of a grid, set if the cell is walkable; row after row, each row starting a
+// new word. Built once per map and shared by every LazyThetaStar search over it, so its
+// line-of-sight checks can test a whole range of a row a 64-bit word at a time
+class WalkableMask {
+private:
+
+// ---------- Member variables ----------
+
+	uint32_t words_per_row;
+
+	std::vector<uint64_t> bits;
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor; copies which cells of grid_in are walkable
+	explicit WalkableMask(const Grid& grid_in)
+		: words_per_row{ (uint32_t(grid_in.numCols()) + 63) / 64 },
+		bits(size_t(words_per_row) * grid_in.numRows(), 0) {
+		for (int r = 0; r < grid_in.numRows(); ++r) {
+			for (int c = 0; c < grid_in.numCols(); ++c) {
+				set({ r, c }, grid_in.isWalkable(grid_in.index({ r, c })));
+			}
+		}
+	} // WalkableMask()
+
+	// Updates the bit of a single cell after it changes in the grid
+	void set(const Coordinate& loc, bool walkable) {
+		uint64_t& word = bits[size_t(loc.row) * words_per_row + (uint32_t(loc.col) >> 6)];
+		uint64_t bit = uint64_t(1) << (loc.col & 63);
+		word = walkable ? word | bit : word & ~bit;
+	} // set()
+
+	// Returns true if cells col_low to col_high of row are all walkable
+	bool rowClear(int row, int col_low, int col_high) const {
+		const uint64_t* words = &bits[size_t(row) * words_per_row];
+		uint32_t first = uint32_t(col_low) >> 6, last = uint32_t(col_high) >> 6;
+		uint64_t first_mask = ~uint64_t(0) << (col_low & 63);
+		uint64_t last_mask = ~uint64_t(0) >> (63 - (col_high & 63));
+		if (first == last) {
+			uint64_t mask = first_mask & last_mask;
+			return (words[first] & mask) == mask;
+		}
+		if ((words[first] & first_mask) != first_mask || (words[last] & last_mask) != last_mask) {
+			return false;
+		}
+		for (uint32_t w = first + 1; w < last; ++w) {
+			if (words[w] != ~uint64_t(0)) {
+				return false;
+			}
+		}
+		return true;
+	} // rowClear()
+
+}; // class WalkableMask
+
+
+// Implementation of Lazy Theta*, an any-angle planner: a vertex's parent may be any earlier
+// vertex it can see, so the path is a short list of waypoints joined by straight segments
+// instead of a staircase of grid moves. The search runs over cell centers with 8-connected
+// moves and Euclidean costs, and, like Theta*, tries to give each new vertex its parent's
+// parent. Lazy Theta* assumes that parent is visible when the vertex is pushed and only
+// checks line of sight once the vertex is expanded, falling back to its best expanded
+// neighbor if it is blocked, so most pushed vertices never need a check.
+// A segment has line of sight if every cell its path touches, including cells it only touches
+// at a corner, is walkable; diagonal moves therefore never cut a corner. Checks go over the
+// WalkableMask of the grid one row at a time, testing the whole column range the segment covers
+// in that row at once
+class LazyThetaStar {
+private:
+
+	// Entry in open_list; f_score is stored with the entry so the heap never reads a value
+	// that has changed since the entry was pushed
+	struct OpenEntry {
+
+		// Sum of estimated distance to goal and distance from start
+		double f_score;
+
+		// Index of the vertex in grid
+		uint32_t v;
+
+	}; // OpenEntry struct
+
+	// Functor to compare two open list entries; returns true if entry a's f is greater
+	// than entry b's f
+	class FComp {
+	public:
+
+		bool operator()(const OpenEntry& a, const OpenEntry& b) {
+			return a.f_score > b.f_score;
+		}
+	}; // class FComp
+
+
+// ---------- Member variables ----------
+
+	// Map shared with the other planners; vertex types are read from here
+	const Grid& grid;
+
+	// Parent index and in_open/closed flags of every vertex in the map; start is its own parent
+	SearchState state;
+
+	// Length of the best path found so far from start to every vertex
+	std::vector<double> g_score;
+
+	// Walkable cells of grid, shared with other searches over the same map; must match grid
+	const WalkableMask& walkable;
+
+	// Used for printing the path; filled in by reconstructPath()
+	std::vector<std::vector<Cell>> map;
+
+	// Min f_score priority queue; contains vertices that still need to be explored
+	std::priority_queue<OpenEntry, std::vector<OpenEntry>, FComp> open_list;
+
+	// Finds path from start to goal
+	Coordinate start;
+
+	Coordinate goal;
+
+	// Set by plan(); search() gives up as soon as it is cancelled
+	const CancelToken* cancel = nullptr;
+
+	// Number of vertices explored
+	int num_v_explored = 0;
+
+	// Number of line-of-sight checks made
+	int num_los_checks = 0;
+
+	// Euclidean length of the path found, in cells
+	double total_path_length = 0;
+
+public:
+
+// ---------- Member functions ----------
+
+	// Constructor
+	LazyThetaStar(const Grid& grid_in, const WalkableMask& walkable_in, const Coordinate& start_in,
+		const Coordinate& goal_in)
+		: grid{ grid_in }, state{ grid_in.size(), false },
+		g_score(grid_in.size(), std::numeric_limits<double>::infinity()),
+		walkable{ walkable_in }, start{ start_in }, goal{ goal_in } {
+		// Checks that start and goal are walkable spaces
+		if (!grid.isWalkable(grid.index(start)) || !grid.isWalkable(grid.index(goal))) {
+			std::cerr << "Invalid start or goal coordinate\n";
+			exit(1);
+		}
+	} // LazyThetaStar()
+
+	// Uses Lazy Theta* to find an any-angle path from start to goal; grid_path is the path a
+	// grid planner found between the same cells, whose length is printed for comparison
+	std::vector<std::vector<Cell>> findPath(const PathResult& grid_path) {
+		search();
+		// Draw the segments between the waypoints found
+		reconstructPath();
+		// Print data describing path
+		printData(grid_path);
+
+		return map;
+	} // findPath()
+
+	// Same as findPath(), but prints nothing and returns the waypoints of the path, from start
+	// to goal, instead of a map; the agent moves in a straight line from each to the next. The
+	// search gives up early if cancel_in is set
+	PathResult plan(const CancelToken* cancel_in = nullptr) {
+		cancel = cancel_in;
+		if (!search()) {
+			return { {}, num_v_explored, true };
+		}
+		return { waypoints(), num_v_explored };
+	} // plan()
+
+	// Euclidean length of the path found, in cells; 0 if none was found
+	double pathLength() const {
+		return total_path_length;
+	} // pathLength()
+
+	// Number of line-of-sight checks made by the search
+	int numLineOfSightChecks() const {
+		return num_los_checks;
+	} // numLineOfSightChecks()
+
+private:
+
+	// Runs Lazy Theta* until goal is expanded or open_list is empty; returns false if it was
+	// cancelled first
+	bool search() {
+		uint32_t v_start = grid.index(start);
+		uint32_t v_goal = grid.index(goal);
+		g_score[v_start] = 0;
+		state.parent[v_start] = v_start;
+		open_list.push({ distance(v_start, v_goal), v_start });
+
+		while (!open_list.empty()) {
+			// Stop early if the search has been cancelled
+			if (isCancelled(cancel)) {
+				return false;
+			}
+			uint32_t v_min = open_list.top().v;
+			open_list.pop();
+			if (state.test(v_min, SearchState::closed)) {
+				continue;
+			}
+			// Now that v_min is expanded, make sure it can see the parent it was given
+			setVertex(v_min);
+			state.set(v_min, SearchState::closed);
+			if (v_min == v_goal) {
+				total_path_length = g_score[v_goal];
+				break;
+			}
+			forEachAdj(v_min, [&](uint32_t adj_v) {
+				if (!state.test(adj_v, SearchState::closed)) {
+					updateVertex(v_min, adj_v);
+				}
+			});
+		}
+		return true;
+	} // search()
+
+	// Offers adj_v the parent of v, assuming it can see it
+	void updateVertex(uint32_t v, uint32_t adj_v) {
+		++num_v_explored;
+		uint32_t p = state.parent[v];
+		double new_g_score = g_score[p] + distance(p, adj_v);
+		if (new_g_score < g_score[adj_v]) {
+			g_score[adj_v] = new_g_score;
+			state.parent[adj_v] = p;
+			open_list.push({ new_g_score + distance(adj_v, grid.index(goal)), adj_v });
+		}
+	} // updateVertex()
+
+	// If v cannot see its parent, makes its parent the expanded neighbor through which it is
+	// closest to start instead; one of them pushed v, so there is always one
+	void setVertex(uint32_t v) {
+		uint32_t p = state.parent[v];
+		if (p == v || lineOfSight(p, v)) {
+			return;
+		}
+		g_score[v] = std::numeric_limits<double>::infinity();
+		forEachAdj(v, [&](uint32_t adj_v) {
+			if (state.test(adj_v, SearchState::closed) && g_score[adj_v] + distance(adj_v, v) < g_score[v]) {
+				g_score[v] = g_score[adj_v] + distance(adj_v, v);
+				state.parent[v] = adj_v;
+			}
+		});
+	} // setVertex()
+
+	// Calls visit on each of the 8 neighbors of v that can be moved to; a diagonal move needs
+	// both cells beside it to be walkable as well
+	template <typename Visit>
+	void forEachAdj(uint32_t v, Visit visit) const {
+		Coordinate loc = grid.coord(v);
+		bool up = loc.row != 0 && grid.isWalkable(grid.above(v));
+		bool down = loc.row != grid.numRows() - 1 && grid.isWalkable(grid.below(v));
+		bool left = loc.col != 0 && grid.isWalkable(grid.left(v));
+		bool right = loc.col != grid.numCols() - 1 && grid.isWalkable(grid.right(v));
+		if (up) {
+			visit(grid.above(v));
+		}
+		if (down) {
+			visit(grid.below(v));
+		}
+		if (left) {
+			visit(grid.left(v));
+		}
+		if (right) {
+			visit(grid.right(v));
+		}
+		if (up && left && grid.isWalkable(grid.left(grid.above(v)))) {
+			visit(grid.left(grid.above(v)));
+		}
+		if (up && right && grid.isWalkable(grid.right(grid.above(v)))) {
+			visit(grid.right(grid.above(v)));
+		}
+		if (down && left && grid.isWalkable(grid.left(grid.below(v)))) {
+			visit(grid.left(grid.below(v)));
+		}
+		if (down && right && grid.isWalkable(grid.right(grid.below(v)))) {
+			visit(grid.right(grid.below(v)));
+		}
+	} // forEachAdj()
+
+	// Returns true if every cell touched by the segment between the centers of cells a and b is
+	// walkable. Coordinates are doubled so that cell centers and edges are integers: cell (r, c)
+	// covers rows 2r to 2r + 2 and columns 2c to 2c + 2, and its center is (2r + 1, 2c + 1)
+	bool lineOfSight(uint32_t a, uint32_t b) {
+		++num_los_checks;
+		Coordinate p = grid.coord(a);
+		Coordinate q = grid.coord(b);
+		if (p.row > q.row) {
+			std::swap(p, q);
+		}
+		if (p.row == q.row) {
+			return walkable.rowClear(p.row, std::min(p.col, q.col), std::max(p.col, q.col));
+		}
+		long long x0 = 2 * p.col + 1, y0 = 2 * p.row + 1;
+		long long dx = 2 * (q.col - p.col), dy = 2 * (q.row - p.row);
+		for (int row = p.row; row <= q.row; ++row) {
+			// Part of the segment inside this row, and the columns it spans there, times dy
+			long long y_low = std::max<long long>(2 * row, y0);
+			long long y_high = std::min<long long>(2 * row + 2, y0 + dy);
+			long long x_low = x0 * dy + (y_low - y0) * dx;
+			long long x_high = x0 * dy + (y_high - y0) * dx;
+			if (x_low > x_high) {
+				std::swap(x_low, x_high);
+			}
+			// Every cell whose edges reach the span, including ones it only touches
+			long long col_low = -floorDiv(-(x_low - 2 * dy), 2 * dy);
+			long long col_high = floorDiv(x_high, 2 * dy);
+			if (!walkable.rowClear(row, int(std::max(0LL, col_low)), int(std::min<long long>(grid.numCols() - 1, col_high)))) {
+				return false;
+			}
+		}
+		return true;
+	} // lineOfSight()
+
+	// Rounds a / b down; b must be positive
+	static long long floorDiv(long long a, long long b) {
+		return a >= 0 ? a / b : -((-a + b - 1) / b);
+	} // floorDiv()
+
+	// Euclidean distance between the centers of cells a and b
+	double distance(uint32_t a, uint32_t b) const {
+		Coordinate loc_a = grid.coord(a);
+		Coordinate loc_b = grid.coord(b);
+		return std::hypot(double(loc_a.row - loc_b.row), double(loc_a.col - loc_b.col));
+	} // distance()
+
+	// Waypoints from start to goal; empty if goal was not reached
+	std::vector<Coordinate> waypoints() const {
+		std::vector<Coordinate> path;
+		uint32_t v_goal = grid.index(goal);
+		if (!state.test(v_goal, SearchState::closed)) {
+			return path;
+		}
+		for (uint32_t v = v_goal; ; v = state.parent[v]) {
+			path.push_back(grid.coord(v));
+			if (state.parent[v] == v) {
+				break;
+			}
+		}
+		std::reverse(path.begin(), path.end());
+		return path;
+	} // waypoints()
+
+	// Marks the cells along each segment of the path as "path", drawing the segments with
+	// Bresenham's line algorithm
+	void reconstructPath() {
+		map = grid.toMap();
+		std::vector<Coordinate> path = waypoints();
+		if (path.empty()) {
+			std::cout << "No path found\n";
+			return;
+		}
+		for (size_t i = 0; i + 1 < path.size(); ++i) {
+			int r = path[i].row, c = path[i].col;
+			int dr = abs(path[i + 1].row - r), dc = abs(path[i + 1].col - c);
+			int step_r = path[i + 1].row > r ? 1 : -1, step_c = path[i + 1].col > c ? 1 : -1;
+			int err = dc - dr;
+			while (true) {
+				if (!(Coordinate{ r, c } == start) && !(Coordinate{ r, c } == goal)) {
+					map[r][c] = Cell::path;
+				}
+				if (r == path[i + 1].row && c == path[i + 1].col) {
+					break;
+				}
+				int err2 = 2 * err;
+				if (err2 > -dr) {
+					err -= dr;
+					c += step_c;
+				}
+				if (err2 < dc) {
+					err += dc;
+					r += step_r;
+				}
+			}
+		}
+	} // reconstructPath()
+
+	// Prints out data describing path, and the length of grid_path for comparison
+	void printData(const PathResult& grid_path) const {
+		std::vector<Coordinate> path = waypoints();
+		std::cout << "Lazy Theta* path \n";
+		std::cout << "Cells examined: " << num_v_explored << "\n";
+		std::cout << "Line-of-sight checks: " << num_los_checks << "\n";
+		std::cout << "Waypoints: " << path.size() << "\n";
+		std::cout << "Path length: " << std::fixed << std::setprecision(2) << total_path_length
+			<< std::defaultfloat << "\n";
+		std::cout << "Grid A* path length: " << (grid_path.path.empty() ? 0 : grid_path.path.size() - 1)
+			<< " (" << grid_path.path.size() << " waypoints)\n\n";
+	} // printData()
+
+}; // class LazyThetaStar
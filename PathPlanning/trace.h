@@ -0,0 +1,248 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include "structs.h"
+
+
+// Records what a search does, one event per push, pop, and expansion, into a ring buffer
+// owned by the calling thread. Planners call TRACE_SEARCH(), which compiles to nothing unless
+// PATHPLANNING_TRACE is defined, so normal builds pay nothing. With tracing on, an event is
+// one 16-byte store into a preallocated buffer; once the buffer is full the oldest events are
+// overwritten. dump() writes the calling thread's events to a compact binary file, and
+// renderHeatmap() turns one search in such a file into a PPM image of its expansion order
+#ifdef PATHPLANNING_TRACE
+#define TRACE_SEARCH(kind, v, g, f) SearchTrace::record(SearchTrace::kind, v, g, f)
+#else
+#define TRACE_SEARCH(kind, v, g, f) ((void)0)
+#endif
+
+class SearchTrace {
+public:
+
+	// True if planners record events in this build
+#ifdef PATHPLANNING_TRACE
+	static constexpr bool enabled = true;
+#else
+	static constexpr bool enabled = false;
+#endif
+
+	// Kinds of events; begin starts a new search at its start cell
+	enum Kind : uint32_t {
+		begin,
+		push,
+		pop,
+		expand
+	};
+
+	// Events kept per thread; older events are overwritten
+	static constexpr uint32_t capacity = 1u << 22;
+
+private:
+
+	// Event as stored; the kind has its own field, so every 32-bit cell index can be recorded.
+	// g and f are -1 for planners that do not have them
+	struct Event {
+
+		uint32_t v;
+
+		int32_t g;
+
+		int32_t f;
+
+		uint32_t kind;
+
+	}; // struct Event
+
+	// Ring buffer of one thread; allocated on the thread's first event, but only the pages
+	// written are ever touched
+	struct Buffer {
+
+		std::unique_ptr<Event[]> events{ new Event[capacity] };
+
+		// Number of events recorded; the next one goes to events[head % capacity]
+		uint64_t head = 0;
+
+	}; // struct Buffer
+
+	// Header of a trace file, followed by one bit per cell that is set if the cell is walkable,
+	// row-major and padded to a whole byte, and then num_events events of four 32-bit words
+	// each (cell, g, f, kind), with cell indices converted to row * cols + col
+	struct FileHeader {
+
+		char magic[4];
+
+		uint32_t rows;
+
+		uint32_t cols;
+
+		uint32_t num_events;
+
+	}; // struct FileHeader
+
+public:
+
+// ---------- Member functions ----------
+
+	// Appends an event to the calling thread's buffer
+	static void record(Kind kind, uint32_t v, int g, int f) {
+		Buffer& buffer = threadBuffer();
+		buffer.events[buffer.head++ & (capacity - 1)] = { v, g, f, kind };
+	} // record()
+
+	// Discards the calling thread's events
+	static void clear() {
+		threadBuffer().head = 0;
+	} // clear()
+
+	// Writes the calling thread's events, oldest first, and the walkable cells of grid, which
+	// every event must refer to, to file; returns false if it cannot be written
+	static bool dump(const std::string& file, const Grid& grid) {
+		Buffer& buffer = threadBuffer();
+		uint32_t num_events = uint32_t(std::min<uint64_t>(buffer.head, capacity));
+		FileHeader header = { { 'T', 'R', 'C', '2' }, uint32_t(grid.numRows()), uint32_t(grid.numCols()), num_events };
+		std::vector<uint8_t> walkable((size_t(header.rows) * header.cols + 7) / 8, 0);
+		for (int r = 0; r < grid.numRows(); ++r) {
+			for (int c = 0; c < grid.numCols(); ++c) {
+				size_t i = size_t(r) * grid.numCols() + c;
+				walkable[i / 8] |= uint8_t(grid.isWalkable(grid.index({ r, c }))) << (i % 8);
+			}
+		}
+		std::vector<Event> events(num_events);
+		for (uint32_t i = 0; i < num_events; ++i) {
+			Event e = buffer.events[(buffer.head - num_events + i) & (capacity - 1)];
+			Coordinate loc = grid.coord(e.v);
+			e.v = uint32_t(loc.row) * header.cols + uint32_t(loc.col);
+			events[i] = e;
+		}
+
+		FILE* out = fopen(file.c_str(), "wb");
+		if (!out) {
+			return false;
+		}
+		bool ok = fwrite(&header, sizeof(header), 1, out) == 1
+			&& fwrite(walkable.data(), 1, walkable.size(), out) == walkable.size()
+			&& fwrite(events.data(), sizeof(Event), events.size(), out) == events.size();
+		return fclose(out) == 0 && ok;
+	} // dump()
+
+	// Renders search number search_index of a trace file (counting from 0; -1 for the last) as
+	// a PPM image: obstacles are black, cells the search never reached are white, cells that
+	// were pushed but never expanded are gray, and expanded cells go from blue to red in the
+	// order they were expanded. Small maps are scaled up. Returns false if the trace cannot be
+	// read or has no such search
+	static bool renderHeatmap(const std::string& trace_file, const std::string& ppm_file, int search_index = -1) {
+		FILE* in = fopen(trace_file.c_str(), "rb");
+		if (!in) {
+			return false;
+		}
+		FileHeader header;
+		bool ok = fread(&header, sizeof(header), 1, in) == 1 && memcmp(header.magic, "TRC2", 4) == 0;
+		// The sizes in the header must match the rest of the file before anything is allocated
+		// for them, so a truncated or corrupt trace is rejected instead of read
+		long data_start = ok ? ftell(in) : -1;
+		ok = ok && data_start >= 0 && fseek(in, 0, SEEK_END) == 0;
+		long data_end = ok ? ftell(in) : -1;
+		ok = ok && data_end >= data_start && fseek(in, data_start, SEEK_SET) == 0 && header.num_events <= capacity
+			&& (uint64_t(header.rows) * header.cols + 7) / 8 + uint64_t(header.num_events) * sizeof(Event)
+			== uint64_t(data_end - data_start);
+		std::vector<uint8_t> walkable;
+		std::vector<Event> events;
+		if (ok) {
+			walkable.resize((size_t(header.rows) * header.cols + 7) / 8);
+			events.resize(header.num_events);
+			ok = fread(walkable.data(), 1, walkable.size(), in) == walkable.size()
+				&& fread(events.data(), sizeof(Event), events.size(), in) == events.size();
+		}
+		fclose(in);
+		if (!ok) {
+			return false;
+		}
+
+		// Find the events of the requested search
+		std::vector<size_t> begins;
+		for (size_t i = 0; i < events.size(); ++i) {
+			if (events[i].kind == begin) {
+				begins.push_back(i);
+			}
+		}
+		if (search_index < 0) {
+			search_index += int(begins.size());
+		}
+		if (search_index < 0 || search_index >= int(begins.size())) {
+			return false;
+		}
+		size_t first = begins[search_index];
+		size_t last = size_t(search_index) + 1 < begins.size() ? begins[search_index + 1] : events.size();
+
+		// Order in which each cell was first expanded; -1 if it never was, -2 if it was only
+		// pushed
+		size_t num_cells = size_t(header.rows) * header.cols;
+		std::vector<int> order(num_cells, -1);
+		int num_expanded = 0;
+		for (size_t i = first; i < last; ++i) {
+			uint32_t kind = events[i].kind;
+			uint32_t v = events[i].v;
+			if (v >= num_cells) {
+				continue;
+			}
+			if (kind == expand && order[v] < 0) {
+				order[v] = num_expanded++;
+			}
+			else if (kind == push && order[v] == -1) {
+				order[v] = -2;
+			}
+		}
+
+		uint32_t scale = std::max(1u, 512 / std::max(header.rows, header.cols));
+		FILE* out = fopen(ppm_file.c_str(), "wb");
+		if (!out) {
+			return false;
+		}
+		fprintf(out, "P6\n%u %u\n255\n", header.cols * scale, header.rows * scale);
+		std::vector<uint8_t> row_pixels(size_t(header.cols) * scale * 3);
+		for (uint32_t r = 0; r < header.rows; ++r) {
+			for (uint32_t c = 0; c < header.cols; ++c) {
+				size_t i = size_t(r) * header.cols + c;
+				uint8_t rgb[3] = { 255, 255, 255 };
+				if (!(walkable[i / 8] >> (i % 8) & 1)) {
+					rgb[0] = rgb[1] = rgb[2] = 0;
+				}
+				else if (order[i] == -2) {
+					rgb[0] = rgb[1] = rgb[2] = 192;
+				}
+				else if (order[i] >= 0) {
+					heatColor(num_expanded > 1 ? double(order[i]) / (num_expanded - 1) : 0, rgb);
+				}
+				for (uint32_t s = 0; s < scale; ++s) {
+					memcpy(&row_pixels[(size_t(c) * scale + s) * 3], rgb, 3);
+				}
+			}
+			for (uint32_t s = 0; s < scale; ++s) {
+				ok = ok && fwrite(row_pixels.data(), 1, row_pixels.size(), out) == row_pixels.size();
+			}
+		}
+		return fclose(out) == 0 && ok;
+	} // renderHeatmap()
+
+private:
+
+	static Buffer& threadBuffer() {
+		thread_local Buffer buffer;
+		return buffer;
+	} // threadBuffer()
+
+	// Color of position t between 0 and 1 on a blue, cyan, green, yellow, red scale
+	static void heatColor(double t, uint8_t rgb[3]) {
+		double r = std::min(1.0, std::max(0.0, 4 * t - 2));
+		double g = std::min(1.0, std::min(4 * t, 4 - 4 * t));
+		double b = std::min(1.0, std::max(0.0, 2 - 4 * t));
+		rgb[0] = uint8_t(255 * r);
+		rgb[1] = uint8_t(255 * std::max(0.0, g));
+		rgb[2] = uint8_t(255 * b);
+	} // heatColor()
+
+}; // class SearchTrace